@@ -9,9 +9,11 @@
 #define ONDRA_SHARED_ASYNC_FUTURE_H_wdj239edj3u30
 
 #include <atomic>
+#include <cstddef>
 #include <exception>
 #include <list>
 #include <memory>
+#include <type_traits>
 
 
 
@@ -19,8 +21,20 @@
 namespace ondra_shared {
 
 class async_future_common {
+public:
+
+    ///Size of one inline slot for a callback (see the inline_cbs template argument)
+    static constexpr std::size_t inline_callback_size = 4*sizeof(void *);
+
 protected:
 
+    ///Callback registered on the future
+    /**
+     * Callbacks form an intrusive singly linked list. The list is built as
+     * lock-free stack (newest first), it is reversed before it is flushed, so
+     * callbacks are always called in registration order. Processing of the list
+     * is iterative, so there is no recursion, regardless on count of callbacks
+     */
     template<typename Me>
     class AbstractCallback {
     public:
@@ -29,20 +43,62 @@ protected:
         AbstractCallback(const AbstractCallback &other) = delete;
         AbstractCallback& operator=(const AbstractCallback &other) = delete;
         virtual void run(const Me &, bool async) noexcept = 0;
-        virtual ~AbstractCallback() {
-            if (next) delete next;
+        ///Moves the callback out of the inline storage
+        /**
+         * @return pointer to callback which is allocated on the heap. The original
+         * callback is destroyed if it was moved.
+         */
+        virtual AbstractCallback *relocate() {return this;}
+        ///Destroys the callback
+        virtual void release() noexcept {delete this;}
+        virtual ~AbstractCallback() = default;
+
+        ///Reverses list in place
+        static AbstractCallback *reverse(AbstractCallback *l) noexcept {
+            AbstractCallback *r = nullptr;
+            while (l) {
+                AbstractCallback *nx = l->next;
+                l->next = r;
+                r = l;
+                l = nx;
+            }
+            return r;
         }
-        void flush_down(const Me &x, bool async) {
-            run(x,async);
-            if (next) next->flush_down(x,async);
+        ///Relocates whole list out of inline storage (order is kept)
+        static AbstractCallback *relocate_all(AbstractCallback *l) {
+            AbstractCallback *r = nullptr;
+            AbstractCallback **tail = &r;
+            while (l) {
+                AbstractCallback *nx = l->next;
+                AbstractCallback *z = l->relocate();
+                z->next = nullptr;
+                *tail = z;
+                tail = &z->next;
+                l = nx;
+            }
+            return r;
+        }
+        ///Calls and destroys all callbacks of the list in registration order
+        /**
+         * @param l list as it was collected (newest first)
+         */
+        static void flush_all(AbstractCallback *l, const Me &x, bool async) noexcept {
+            l = reverse(l);
+            while (l) {
+                AbstractCallback *nx = l->next;
+                l->run(x,async);
+                l->release();
+                l = nx;
+            }
         }
     };
 
     template<typename Me, typename Fn>
     class Callback: public AbstractCallback<Me> {
     public:
-        Callback(Fn &&fn, AbstractCallback<Me> *next)
-            :AbstractCallback<Me>(next), fn(std::forward<Fn>(fn)) {}
+        template<typename X>
+        Callback(X &&fn, AbstractCallback<Me> *next)
+            :AbstractCallback<Me>(next), fn(std::forward<X>(fn)) {}
         virtual void run(const Me &x, bool) noexcept {
             fn(x);
         }
@@ -52,8 +108,9 @@ protected:
     template<typename Me, typename Fn>
     class Callback2: public AbstractCallback<Me> {
     public:
-        Callback2(Fn &&fn, AbstractCallback<Me> *next)
-            :AbstractCallback<Me>(next), fn(std::forward<Fn>(fn)) {}
+        template<typename X>
+        Callback2(X &&fn, AbstractCallback<Me> *next)
+            :AbstractCallback<Me>(next), fn(std::forward<X>(fn)) {}
         virtual void run(const Me &x, bool b) noexcept {
             fn(x,b);
         }
@@ -61,6 +118,51 @@ protected:
         Fn fn;
     };
 
+    ///Callback constructed in inline storage of the future
+    template<typename Me, typename Base>
+    class InlineCallback: public Base {
+    public:
+        using Base::Base;
+        virtual AbstractCallback<Me> *relocate() override {
+            AbstractCallback<Me> *r = new Base(std::move(this->fn), nullptr);
+            this->~InlineCallback();
+            return r;
+        }
+        virtual void release() noexcept override {
+            this->~InlineCallback();
+        }
+    };
+
+    ///Inline storage for first N callbacks
+    /**
+     * Slots are claimed by atomic counter, they are never reused, because the
+     * future is resolved only once.
+     */
+    template<typename Me, std::size_t N>
+    class InlineCallbackSlots {
+    public:
+        InlineCallbackSlots():_used(0) {}
+        template<typename Base, typename Fn>
+        AbstractCallback<Me> *alloc(Fn &&fn) {
+            using CB = InlineCallback<Me, Base>;
+            if (sizeof(CB) > inline_callback_size || alignof(CB) > alignof(Slot)) return nullptr;
+            std::size_t idx = _used.fetch_add(1, std::memory_order_relaxed);
+            if (idx >= N) return nullptr;
+            return new(&_slots[idx]) CB(std::forward<Fn>(fn), nullptr);
+        }
+    protected:
+        using Slot = typename std::aligned_storage<inline_callback_size, alignof(std::max_align_t)>::type;
+        std::atomic<std::size_t> _used;
+        Slot _slots[N];
+    };
+
+    template<typename Me>
+    class InlineCallbackSlots<Me, 0> {
+    public:
+        template<typename Base, typename Fn>
+        AbstractCallback<Me> *alloc(Fn &&) {return nullptr;}
+    };
+
 
 };
 
@@ -90,8 +192,11 @@ protected:
  *
  * @tparam T type of the value. You can use void to get untyped future (which has special
  * features, see futher doc)
+ * @tparam inline_cbs count of callbacks which can be stored inside of the future
+ * object without allocation. Callback must fit to inline_callback_size, otherwise
+ * it is allocated on the heap. Default is 0 (all callbacks are allocated)
  */
-template<typename T>
+template<typename T, std::size_t inline_cbs = 0>
 class async_future: public async_future_common {
 public:
 
@@ -136,7 +241,7 @@ public:
 
     async_future(std::exception_ptr eptr);
     
-    template<typename Fn, typename = decltype(std::declval<Fn>()(std::declval<const async_future<T> &>()))>
+    template<typename Fn, typename = decltype(std::declval<Fn>()(std::declval<const async_future &>()))>
     async_future(Fn &&fn):async_future() {
         this->operator>>(std::forward<Fn>(fn));
     }
@@ -233,13 +338,13 @@ public:
      * that future will be never resolved)
      */
     template<typename Fn>
-    auto operator>>(Fn &&cb) -> decltype(std::declval<Fn>()(std::declval<const async_future<T> &>()), std::declval<async_future &&>()) {
+    auto operator>>(Fn &&cb) -> decltype(std::declval<Fn>()(std::declval<const async_future &>()), std::declval<async_future &&>()) {
     	addfn1(std::forward<Fn>(cb));
     	return std::move(*this);
     }
 
     template<typename Fn>
-    auto operator>>(Fn &&cb) -> decltype(std::declval<Fn>()(std::declval<const async_future<T> &>(), std::declval<bool>()), std::declval<async_future &&>()) {
+    auto operator>>(Fn &&cb) -> decltype(std::declval<Fn>()(std::declval<const async_future &>(), std::declval<bool>()), std::declval<async_future &&>()) {
     	addfn2(std::forward<Fn>(cb));
     	return std::move(*this);
     }
@@ -272,11 +377,12 @@ public:
 
 protected:
 
-    using AbstractCallback = async_future_common::AbstractCallback<async_future<T> >;
+    using AbstractCallback = async_future_common::AbstractCallback<async_future>;
 
 
     std::atomic<bool> _resolved;
     std::atomic<AbstractCallback *> _callbacks;
+    InlineCallbackSlots<async_future, inline_cbs> _inline_cbs;
 
     bool _is_exception;
     union {
@@ -294,6 +400,9 @@ protected:
     template<typename Fn>
     void addfn2(Fn &&cb);
 
+    template<typename CB, typename Fn>
+    AbstractCallback *alloc_cb(Fn &&cb);
+
 };
 
 
@@ -310,19 +419,18 @@ public:
 };
 
 
-template<typename T>
-inline async_future<T>::async_future()
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future()
 :_resolved(false),_callbacks(nullptr),_is_exception(false)
 {
 }
 
-template<typename T>
-inline async_future<T>::async_future(async_future &&other)
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future(async_future &&other)
 :_resolved(other.is_ready())
-,_callbacks(other._callbacks.load())
+,_callbacks(AbstractCallback::relocate_all(other._callbacks.exchange(nullptr)))
 ,_is_exception(other._is_exception)
 {
-    other._callbacks = nullptr;
     if (is_ready()) {
         if (_is_exception) {
             new(&_eptr) std::exception_ptr(std::move(other._eptr));
@@ -332,8 +440,8 @@ inline async_future<T>::async_future(async_future &&other)
     }
 }
 
-template<typename T>
-inline async_future<T>::async_future(const async_future &other)
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future(const async_future &other)
 :_resolved(other.is_ready())
 ,_callbacks(nullptr)
 ,_is_exception(other._is_exception)
@@ -347,22 +455,22 @@ inline async_future<T>::async_future(const async_future &other)
     }
 }
 
-template<typename T>
-inline async_future<T>::async_future(const T &value)
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future(const T &value)
     :_resolved(true)
     ,_callbacks(nullptr)
     ,_is_exception(false)
     ,_value(value) {}
 
-template<typename T>
-inline async_future<T>::async_future(T &&value)
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future(T &&value)
     :_resolved(true)
     ,_callbacks(nullptr)
     ,_is_exception(false)
     ,_value(std::move(value)) {}
 
-template<typename T>
-inline async_future<T>::async_future(std::exception_ptr eptr)
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::async_future(std::exception_ptr eptr)
 :_resolved(true)
 ,_callbacks(nullptr)
 ,_is_exception(true)
@@ -370,13 +478,10 @@ inline async_future<T>::async_future(std::exception_ptr eptr)
 
 
 
-template<typename T>
-inline async_future<T>::~async_future() {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::~async_future() {
     AbstractCallback *z = _callbacks.exchange(nullptr, std::memory_order_relaxed);
-    if (z) {
-        z->flush_down(*this, true);
-        delete z;
-    }
+    AbstractCallback::flush_all(z, *this, true);
 
     if (is_ready()) {
         if (_is_exception) {
@@ -387,8 +492,8 @@ inline async_future<T>::~async_future() {
     }
 }
 
-template<typename T>
-inline async_future<T>& async_future<T>::operator =(async_future &&other) {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>& async_future<T, inline_cbs>::operator =(async_future &&other) {
     if (&other != this) {
         if (is_ready()) throw async_future_already_resolved();
         if (other.is_ready()) {
@@ -401,14 +506,15 @@ inline async_future<T>& async_future<T>::operator =(async_future &&other) {
             mark_resolved();
         } else {
             AbstractCallback *l = other._callbacks.exchange(nullptr);
-            while (l) l = add_cb(l);
+            l = AbstractCallback::reverse(AbstractCallback::relocate_all(l));
+            while (l) l = add_cb(l, false);
         }
     }
     return *this;
 }
 
-template<typename T>
-inline async_future<T>& async_future<T>::operator =(const async_future &other) {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>& async_future<T, inline_cbs>::operator =(const async_future &other) {
     if (&other != this) {
         if (is_ready()) throw async_future_already_resolved();
         if (other.is_ready()) {
@@ -426,8 +532,8 @@ inline async_future<T>& async_future<T>::operator =(const async_future &other) {
     return *this;
 }
 
-template<typename T>
-inline async_future<T>& async_future<T>::operator =(const T &value) {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>& async_future<T, inline_cbs>::operator =(const T &value) {
     if (is_ready()) throw async_future_already_resolved();
     new(&_value) T(value);
     mark_resolved();
@@ -435,16 +541,16 @@ inline async_future<T>& async_future<T>::operator =(const T &value) {
 
 }
 
-template<typename T>
-inline async_future<T>& async_future<T>::operator =(T &&value) {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>& async_future<T, inline_cbs>::operator =(T &&value) {
     if (is_ready()) throw async_future_already_resolved();
     new(&_value) T(std::move(value));
     mark_resolved();
     return *this;
 }
 
-template<typename T>
-inline async_future<T>& async_future<T>::operator =(std::exception_ptr eptr) {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>& async_future<T, inline_cbs>::operator =(std::exception_ptr eptr) {
     if (is_ready()) throw async_future_already_resolved();
     _is_exception = true;
     new(&_eptr) std::exception_ptr(eptr);
@@ -452,59 +558,62 @@ inline async_future<T>& async_future<T>::operator =(std::exception_ptr eptr) {
     return *this;
 }
 
-template<typename T>
-inline async_future<T>::operator const T&() const {
+template<typename T, std::size_t inline_cbs>
+inline async_future<T, inline_cbs>::operator const T&() const {
     if (!is_ready()) throw async_future_not_ready();
     if (_is_exception) std::rethrow_exception(_eptr);
     else return _value;
 }
 
-template<typename T>
+template<typename T, std::size_t inline_cbs>
 template<typename Fn>
-inline void async_future<T>::addfn1(Fn &&fn) {
-    using Callback = async_future_common::Callback<async_future<T>, Fn >;
+inline void async_future<T, inline_cbs>::addfn1(Fn &&fn) {
+    using Callback = async_future_common::Callback<async_future, typename std::decay<Fn>::type>;
     if (is_ready()) {
         fn(*this);
     } else {
-        auto lt = std::make_unique<Callback>(std::forward<Fn>(fn), nullptr);
-        add_cb(lt.release(), false);
+        add_cb(alloc_cb<Callback>(std::forward<Fn>(fn)), false);
     }
 }
 
-template<typename T>
+template<typename T, std::size_t inline_cbs>
 template<typename Fn>
-inline void async_future<T>::addfn2(Fn &&fn) {
-    using Callback2 = async_future_common::Callback2<async_future<T>, Fn >;
+inline void async_future<T, inline_cbs>::addfn2(Fn &&fn) {
+    using Callback2 = async_future_common::Callback2<async_future, typename std::decay<Fn>::type>;
     if (is_ready()) {
         fn(*this,false);
     } else {
-        auto lt = std::make_unique<Callback2>(std::forward<Fn>(fn), nullptr);
-        add_cb(lt.release(), false);
+        add_cb(alloc_cb<Callback2>(std::forward<Fn>(fn)), false);
     }
 }
 
-template<typename T>
-inline bool async_future<T>::is_ready() const {
+template<typename T, std::size_t inline_cbs>
+template<typename CB, typename Fn>
+inline typename async_future<T, inline_cbs>::AbstractCallback *async_future<T, inline_cbs>::alloc_cb(Fn &&fn) {
+    AbstractCallback *r = _inline_cbs.template alloc<CB>(std::forward<Fn>(fn));
+    if (r == nullptr) r = new CB(std::forward<Fn>(fn), nullptr);
+    return r;
+}
+
+template<typename T, std::size_t inline_cbs>
+inline bool async_future<T, inline_cbs>::is_ready() const {
     return _resolved.load(std::memory_order_acquire);
 }
 
 
-template<typename T>
-inline void async_future<T>::mark_resolved() {
+template<typename T, std::size_t inline_cbs>
+inline void async_future<T, inline_cbs>::mark_resolved() {
     _resolved.store(true, std::memory_order_release);
     flush_cbs(true);
 }
-template<typename T>
-inline void async_future<T>::flush_cbs(bool async) {
+template<typename T, std::size_t inline_cbs>
+inline void async_future<T, inline_cbs>::flush_cbs(bool async) {
     AbstractCallback *l = _callbacks.exchange(nullptr);
-    if (l) {
-        l->flush_down(*this, async);
-        delete l;
-    }
+    AbstractCallback::flush_all(l, *this, async);
 }
 
-template<typename T>
-inline typename async_future<T>::AbstractCallback* async_future<T>::add_cb(AbstractCallback *itm, bool async) {
+template<typename T, std::size_t inline_cbs>
+inline typename async_future<T, inline_cbs>::AbstractCallback* async_future<T, inline_cbs>::add_cb(AbstractCallback *itm, bool async) {
     AbstractCallback *nx = itm->next;
     itm->next = nullptr;
     while (!_callbacks.compare_exchange_weak(itm->next, itm)) ;
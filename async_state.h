@@ -10,36 +10,74 @@
 
 #include <algorithm>
 #include <atomic>
+#include <functional>
 #include <mutex>
+#include <thread>
+#include "fastsharedalloc.h"
 #include "move_only_function.h"
 
 namespace ondra_shared {
 
-template<typename State>
+///Lightweight lock for states which are locked only for very short time
+/**
+ * Use it as Lock argument of the async_state_t. The lock spins for a while, then
+ * it starts to yield the CPU. It is not fair, and it is not recursive.
+ */
+class async_state_spinlock {
+public:
+    void lock() noexcept {
+        int cnt = 0;
+        while (_flag.test_and_set(std::memory_order_acquire)) {
+            if (++cnt > spin_count) std::this_thread::yield();
+        }
+    }
+    void unlock() noexcept {
+        _flag.clear(std::memory_order_release);
+    }
+    bool try_lock() noexcept {
+        return !_flag.test_and_set(std::memory_order_acquire);
+    }
+protected:
+    static constexpr int spin_count = 64;
+    std::atomic_flag _flag = ATOMIC_FLAG_INIT;
+};
+
+template<typename State, typename Lock = std::mutex>
 class async_state_t;
 
 
 namespace async_state_details {
-template<typename State>
+template<typename State, typename Lock = std::mutex>
 class holder_t;
 }
 ;
 
 ///Declaration of AsyncState pointer
-template<typename State>
+/**
+ * @tparam State type of state. Use const State for state which doesn't need locking
+ * @tparam Lock type of lock used to lock mutable state. Default is std::mutex. You
+ * can use async_state_spinlock for states which are locked only briefly.
+ *
+ * States are allocated through the FastSharedAlloc, so memory of released states
+ * is recycled, and short-lived operations don't need to call the global allocator
+ * once the cache is filled.
+ */
+template<typename State, typename Lock>
 class async_state_t {
 public:
 
+    using Holder = async_state_details::holder_t<State, Lock>;
+
     ///construct async shared state
     template<typename X, typename ... Args>
-    static async_state_t<State> make(Args &&... args) {
-        return async_state_t(new async_state_details::holder_t<State>(std::forward<Args>(args)...));
+    static async_state_t make(Args &&... args) {
+        return async_state_t(new Holder(std::forward<Args>(args)...));
     }
 
     ///construct async shared state
     template<typename X, typename ... Args>
-    static async_state_t<State> make(State && st) {
-        return async_state_t(new async_state_details::holder_t<State>(std::move(st)));
+    static async_state_t make(State && st) {
+        return async_state_t(new Holder(std::move(st)));
     }
 
 
@@ -163,7 +201,7 @@ public:
         return _ptr == nullptr;
     }
 
-    using StateT = typename async_state_details::holder_t<State>::StateT;
+    using StateT = typename Holder::StateT;
 
     ///Associate a finalizing callback function
     /**
@@ -172,10 +210,14 @@ public:
      * - because it is no longer shared so it is safe to modify it. It also allows to callback function to
      * move results without copying
      *
+     * Small function objects are stored inside of the state holder, so they are not allocated
+     *
      * @note Function is not MT Safe - only one thread can set the callback
      */
-    void onFinish(std::function<void(StateT&)> &&callback) {
-        _ptr->_callback = std::move(callback);
+    template<typename Fn>
+    void onFinish(Fn &&callback) {
+        if (is_empty(callback)) _ptr->_callback = nullptr;
+        else _ptr->_callback = std::forward<Fn>(callback);
     }
     ///Associate a finalizing callback function
     /**
@@ -187,13 +229,21 @@ public:
      * @note Function is not MT Safe - only one thread can set the callback
      *
      */
-    void operator>>(std::function<void(StateT&)> &&callback) {
-        _ptr->_callback = std::move(callback);
+    template<typename Fn>
+    void operator>>(Fn &&callback) {
+        onFinish(std::forward<Fn>(callback));
     }
 
 protected:
     ///Pointer to state
-    async_state_details::holder_t<State> *_ptr;
+    Holder *_ptr;
+
+    template<typename Fn>
+    static bool is_empty(const Fn &) {return false;}
+    template<typename Fn>
+    static bool is_empty(const std::function<Fn> &fn) {return !fn;}
+    template<typename Fn>
+    static bool is_empty(Fn *fn) {return fn == nullptr;}
 
     template<typename X, typename ... Args>
     friend async_state_t<X> make_async_state(Args &&... args);
@@ -202,7 +252,7 @@ protected:
     friend async_state_t<X> make_async_state(X &&args);
 
     ///Protected constructor
-    async_state_t(async_state_details::holder_t<State> *ptr) :
+    async_state_t(Holder *ptr) :
             _ptr(ptr) {
         _ptr->addref();
     }
@@ -211,10 +261,13 @@ protected:
 namespace async_state_details {
 
 ///Declaration of state holder for const State
-template<typename State>
-class holder_t<const State> : public State {
+template<typename State, typename Lock>
+class holder_t<const State, Lock> : public State, public FastSharedAlloc {
 public:
 
+    using FastSharedAlloc::operator new;
+    using FastSharedAlloc::operator delete;
+
     using StateT = State;
 
     template<typename ... Args>
@@ -224,10 +277,13 @@ public:
     holder_t(const holder_t &other) = delete;
     holder_t& operator=(const holder_t &other) = delete;
 protected:
-    friend class async_state_t<const State> ;
+    template<typename, typename> friend class ondra_shared::async_state_t;
+
+    ///Callback function - function objects up to 4 pointers are stored inline
+    using CallbackFn = move_only_function<void(State&), 4*sizeof(void *)>;
 
     std::atomic<unsigned int> _shareCount;
-    std::function<void(State&)> _callback;
+    CallbackFn _callback;
 
     void addref() {
         //no ordering is enforced as new reference doesn't need anything from other threads
@@ -257,17 +313,17 @@ protected:
 };
 
 ///Declaration of state holder for mutable State
-template<typename State>
-class holder_t: public holder_t<const State> {
+template<typename State, typename Lock>
+class holder_t: public holder_t<const State, Lock> {
 protected:
 
     using StateT = State;
 
-    friend class async_state_t<State> ;
+    friend class async_state_t<State, Lock> ;
 
-    using holder_t<const State>::holder_t;
+    using holder_t<const State, Lock>::holder_t;
 
-    std::mutex _mx;
+    Lock _mx;
 
     void lock() {
         _mx.lock();
@@ -0,0 +1,875 @@
+/*
+ * binLog.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef _ONDRA_SHARED_BINLOG_H_72390481723094
+#define _ONDRA_SHARED_BINLOG_H_72390481723094
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "stdLogOutput.h"
+
+namespace ondra_shared {
+
+namespace _logDetails {
+
+     inline void putVarint(std::string &out, std::uint64_t v) {
+          while (v >= 0x80) {
+               out.push_back(static_cast<char>(v | 0x80));
+               v >>= 7;
+          }
+          out.push_back(static_cast<char>(v));
+     }
+
+     inline bool getVarint(const char *&p, const char *e, std::uint64_t &v) {
+          v = 0;
+          for (unsigned int shift = 0; p != e && shift < 64; shift += 7) {
+               unsigned char c = static_cast<unsigned char>(*p++);
+               v |= static_cast<std::uint64_t>(c & 0x7F) << shift;
+               if ((c & 0x80) == 0) return true;
+          }
+          return false;
+     }
+
+     inline std::uint64_t zigzag(std::int64_t v) {
+          return (static_cast<std::uint64_t>(v) << 1) ^ static_cast<std::uint64_t>(v >> 63);
+     }
+
+     inline std::int64_t unzigzag(std::uint64_t v) {
+          return static_cast<std::int64_t>(v >> 1) ^ -static_cast<std::int64_t>(v & 1);
+     }
+
+     ///Simple LZ77 compression of the blocks
+     /**
+      * Compressed data are sequences: varint count of literals, literals,
+      * varint offset of the match, varint length of the match - 4. The last
+      * sequence contains literals only
+      */
+     class BinLogLZ {
+     public:
+          static void compress(const char *src, std::size_t n, std::string &out) {
+               static constexpr unsigned int hashBits = 14;
+               static constexpr std::uint32_t none = 0xFFFFFFFF;
+               std::vector<std::uint32_t> table(1U << hashBits, none);
+               std::size_t anchor = 0;
+               std::size_t i = 0;
+               while (i + 4 <= n) {
+                    std::uint32_t seq;
+                    std::memcpy(&seq, src+i, 4);
+                    std::uint32_t h = (seq * 2654435761U) >> (32 - hashBits);
+                    std::uint32_t cand = table[h];
+                    table[h] = static_cast<std::uint32_t>(i);
+                    if (cand != none && std::memcmp(src+cand, src+i, 4) == 0) {
+                         std::size_t len = 4;
+                         while (i + len < n && src[cand+len] == src[i+len]) ++len;
+                         putVarint(out, i - anchor);
+                         out.append(src+anchor, i - anchor);
+                         putVarint(out, i - cand);
+                         putVarint(out, len - 4);
+                         i += len;
+                         anchor = i;
+                    } else {
+                         ++i;
+                    }
+               }
+               putVarint(out, n - anchor);
+               out.append(src+anchor, n - anchor);
+          }
+
+          static bool decompress(const char *src, std::size_t n, std::string &out, std::size_t rawSize) {
+               const char *p = src;
+               const char *e = src+n;
+               out.clear();
+               out.reserve(rawSize);
+               while (p != e) {
+                    std::uint64_t lit, ofs, len;
+                    if (!getVarint(p, e, lit) || lit > static_cast<std::size_t>(e - p)) return false;
+                    out.append(p, lit);
+                    p += lit;
+                    if (p == e) break;
+                    if (!getVarint(p, e, ofs) || !getVarint(p, e, len)) return false;
+                    if (ofs == 0 || ofs > out.size() || out.size() + len + 4 > rawSize) return false;
+                    std::size_t from = out.size() - ofs;
+                    for (std::size_t k = 0; k < len + 4; k++) {
+                         char c = out[from+k];
+                         out.push_back(c);
+                    }
+               }
+               return out.size() == rawSize;
+          }
+     };
+
+     ///Header of the chunk in the binary log (block or index)
+     struct BinLogChunk {
+          static constexpr std::uint32_t magicBlock = 0x4B4C424F; //"OBLK"
+          static constexpr std::uint32_t magicIndex = 0x5844494F; //"OIDX"
+          std::uint32_t magic;
+          ///size of the data after the header
+          std::uint32_t size;
+          ///block: size of uncompressed data, index: count of entries
+          std::uint32_t rawSize;
+          ///block: 0 - not compressed, 1 - BinLogLZ
+          std::uint32_t compression;
+          ///time of the first message in the block (microseconds)
+          std::uint64_t firstTime;
+          ///time of the last message in the block (microseconds)
+          std::uint64_t lastTime;
+     };
+
+     ///Entry of the time index
+     struct BinLogIndexEntry {
+          ///offset of the block in the file
+          std::uint64_t offset;
+          std::uint64_t firstTime;
+          std::uint64_t lastTime;
+     };
+
+     ///Trailer of the file - it refers to the index chunk
+     struct BinLogTrailer {
+          std::uint64_t indexOffset;
+          char magic[8];
+     };
+
+     static constexpr char binLogFileMagic[8] = {'O','S','B','I','N','L','G','1'};
+     static constexpr char binLogTrailerMagic[8] = {'O','S','B','L','T','R','L','1'};
+
+     ///Types of records in the block (the block starts by varint base time)
+     enum BinLogRecord {
+          ///definition of the pattern: id, pattern, types of arguments
+          binLogPattern = 0,
+          ///definition of the section: id, ident
+          binLogSection = 1,
+          ///message: time relative to base, level, thread, section id, pattern id, arguments
+          binLogMessage = 2
+     };
+
+     ///Reads chunk headers of the file
+     /**
+      * @param fd file descriptor
+      * @param fileSize size of the file
+      * @param blocks receives list of blocks
+      * @return offset after last valid block. If the file is closed properly, it is the
+      * offset of the index
+      */
+     inline std::uint64_t binLogLoadIndex(int fd, std::uint64_t fileSize, std::vector<BinLogIndexEntry> &blocks) {
+          blocks.clear();
+          BinLogTrailer trl;
+          BinLogChunk chunk;
+          if (fileSize >= sizeof(binLogFileMagic) + sizeof(trl)
+               && ::pread(fd, &trl, sizeof(trl), static_cast<off_t>(fileSize - sizeof(trl))) == sizeof(trl)
+               && std::memcmp(trl.magic, binLogTrailerMagic, sizeof(trl.magic)) == 0
+               && trl.indexOffset + sizeof(chunk) <= fileSize
+               && ::pread(fd, &chunk, sizeof(chunk), static_cast<off_t>(trl.indexOffset)) == sizeof(chunk)
+               && chunk.magic == BinLogChunk::magicIndex
+               && static_cast<std::uint64_t>(chunk.rawSize) * sizeof(BinLogIndexEntry) == chunk.size) {
+               blocks.resize(chunk.rawSize);
+               ssize_t sz = static_cast<ssize_t>(chunk.size);
+               if (::pread(fd, blocks.data(), chunk.size, static_cast<off_t>(trl.indexOffset + sizeof(chunk))) == sz) {
+                    return trl.indexOffset;
+               }
+               blocks.clear();
+          }
+          //no index, scan headers of blocks
+          std::uint64_t ofs = sizeof(binLogFileMagic);
+          while (ofs + sizeof(chunk) <= fileSize
+                    && ::pread(fd, &chunk, sizeof(chunk), static_cast<off_t>(ofs)) == sizeof(chunk)
+                    && chunk.magic == BinLogChunk::magicBlock
+                    && ofs + sizeof(chunk) + chunk.size <= fileSize) {
+               blocks.push_back(BinLogIndexEntry{ofs, chunk.firstTime, chunk.lastTime});
+               ofs += sizeof(chunk) + chunk.size;
+          }
+          return ofs;
+     }
+
+     ///Writes data at given offset, the position of the descriptor is not used
+     inline bool binLogWrite(int fd, const void *data, std::size_t size, std::uint64_t ofs) {
+          const char *p = static_cast<const char *>(data);
+          while (size) {
+               ssize_t w = ::pwrite(fd, p, size, static_cast<off_t>(ofs));
+               if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return false;
+               }
+               p += w;
+               ofs += static_cast<std::uint64_t>(w);
+               size -= static_cast<std::size_t>(w);
+          }
+          return true;
+     }
+}
+
+///Binary structured log
+/**
+ * Messages are stored in the compact binary form: time, level, thread, section,
+ * pattern and arguments are encoded as varints. Messages logged by logPrintCaptured()
+ * keep their arguments in the binary form, other messages are stored as text.
+ *
+ * Messages are collected to blocks (64KB by default), which are compressed. Every block
+ * contains definitions of patterns and sections it uses, so it can be decoded alone.
+ * The index of times of blocks is written at the end of the file, when the log is
+ * closed. If the index is missing (crash), it is recreated from headers of blocks.
+ *
+ * Block is written when it is full, when the flush() is called, or with the first
+ * message after one second since the last write. A background thread writes the
+ * block which is not empty every second, and immediately after the log rotation is
+ * requested (AbstractLogProvider::rotate()), so the last messages don't stay in the memory.
+ * Use BinLogReader or the tool binlog_reader to read the log.
+ *
+ * @note data are stored in the native byte order
+ * @note available on POSIX platforms
+ */
+class BinLogFile: public StdLogProviderFactory {
+public:
+
+     ///Open the log
+     /**
+      * @param pathname pathname of the log file. If the file exists, new messages are appended
+      * @param minLevel minimum allowed log level
+      * @param blockSize size of uncompressed block
+      */
+     BinLogFile(StrViewA pathname, LogLevel minLevel = LogLevel::info, std::size_t blockSize = 65536)
+          :StdLogProviderFactory(minLevel)
+          ,pathname(pathname)
+          ,blockSize(blockSize)
+     {
+          using namespace _logDetails;
+          fd = ::open(this->pathname.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0666);
+          if (fd < 0) return;
+          struct stat st;
+          if (::fstat(fd, &st) != 0) {
+               closeFile();
+               return;
+          }
+          std::uint64_t size = static_cast<std::uint64_t>(st.st_size);
+          char magic[sizeof(binLogFileMagic)];
+          if (size == 0) {
+               binLogWrite(fd, binLogFileMagic, sizeof(binLogFileMagic), 0);
+               fileEnd = sizeof(binLogFileMagic);
+          } else if (::pread(fd, magic, sizeof(magic), 0) != sizeof(magic)
+                    || std::memcmp(magic, binLogFileMagic, sizeof(magic)) != 0) {
+               //not a binary log
+               closeFile();
+          } else {
+               //continue after the last block, the index is written again on close
+               fileEnd = binLogLoadIndex(fd, size, index);
+               if (::ftruncate(fd, static_cast<off_t>(fileEnd)) != 0) {
+                    closeFile();
+               }
+          }
+          if (fd >= 0) {
+               AbstractLogProvider::rotated(rotateCounter);
+               flusher = std::thread([this]{flusherProc();});
+          }
+     }
+
+     ~BinLogFile() {
+          if (fd < 0) return;
+          {
+               std::lock_guard<std::mutex> _(flushmx);
+               stopping = true;
+          }
+          flushcond.notify_all();
+          flusher.join();
+          flush();
+          writeIndex();
+          closeFile();
+     }
+
+     bool operator! () const {
+          return fd < 0;
+     }
+
+     operator bool() const {
+          return fd >= 0;
+     }
+
+     void setCurrent() {
+          AbstractLogProviderFactory::getInstance() = this;
+          AbstractLogProvider::getInstance() = create();
+     }
+
+     virtual PLogProvider create() override {
+          return PLogProvider(new Provider(this));
+     }
+
+     ///Line sent directly by sendToLog() is stored as text
+     virtual void writeToLog(const StrViewA &line, const std::time_t &t, LogLevel level) override {
+          writeText(static_cast<std::uint64_t>(t) * 1000000, level, 0, StrViewA(), &line, 1);
+     }
+
+     ///Writes current block to the file
+     void flush() {
+          std::lock_guard<std::recursive_mutex> _(lock);
+          flushBlock();
+     }
+
+     ///Create binary log
+     /**
+      * @param pathname pathname to file, if empty, stderr is used (text log)
+      * @param minLevel minimal level
+      * @return log provider
+      */
+     static PStdLogProviderFactory create(StrViewA pathname, LogLevel minLevel) {
+          if (pathname.empty()) return new StdLogProviderFactory(minLevel);
+          else return new BinLogFile(pathname, minLevel);
+     }
+
+protected:
+
+     class Provider: public StdLogProvider {
+     public:
+          Provider(BinLogFile *owner)
+               :StdLogProvider(owner),owner(owner) {}
+          Provider(const Provider &other, StrViewA ident)
+               :StdLogProvider(other, ident),owner(other.owner) {}
+
+          virtual bool start(LogLevel level, MutableStrViewA &b) override {
+               if (!StdLogProvider::isLogLevelEnabled(level)) return false;
+               curLevel = level;
+               buffer.clear();
+               readTime();
+               b = buffer.window();
+               return true;
+          }
+          virtual void commit(const MutableStrViewA &text) override {
+               finishBuffer(text);
+               const std::vector<StrViewA> &parts = buffer.getParts();
+               owner->writeText(getTime(), curLevel, getThreadIdent(), ident, parts.data(), parts.size());
+               buffer.clear();
+          }
+          virtual char *startCapture(LogLevel level, std::size_t size) override {
+               if (!StdLogProvider::isLogLevelEnabled(level)) return nullptr;
+               curLevel = level;
+               readTime();
+               capture.resize(size);
+               return capture.data();
+          }
+          virtual void commitCapture() override {
+               owner->writeCaptured(getTime(), curLevel, getThreadIdent(), ident, capture.data());
+          }
+          virtual PLogProvider newSection(const StrViewA &ident) override {
+               return PLogProvider(new Provider(*this, ident));
+          }
+     protected:
+          BinLogFile *owner;
+          std::vector<char> capture;
+
+          std::uint64_t getTime() const {
+               return static_cast<std::uint64_t>(lastTime) * 1000000 + lastTimeNs / 1000;
+          }
+     };
+
+     using PatternKey = std::pair<const char *, const void *>;
+
+     std::string pathname;
+     std::size_t blockSize;
+     int fd = -1;
+     std::uint64_t fileEnd = 0;
+     std::vector<_logDetails::BinLogIndexEntry> index;
+
+     ///current block (guarded by the lock)
+     std::string block;
+     std::string compressed;
+     std::uint64_t firstTime = 0;
+     std::uint64_t lastTime = 0;
+     std::map<PatternKey, unsigned int> patterns;
+     std::map<std::string, unsigned int> sections;
+     ///time, to which times of messages are related
+     std::uint64_t baseTime = 0;
+     ///time of the last write of the block
+     std::uint64_t writeTime = 0;
+
+     ///Guards the stopping flag
+     std::mutex flushmx;
+     std::condition_variable flushcond;
+     bool stopping = false;
+     ///Writes the block periodically
+     std::thread flusher;
+     ///Last seen state of log rotation (used by the flusher)
+     int rotateCounter = 0;
+
+     void closeFile() {
+          ::close(fd);
+          fd = -1;
+     }
+
+     ///Starts the block, if it is empty. The block starts by the base time
+     void beginBlock(std::uint64_t time) {
+          if (block.empty()) {
+               baseTime = firstTime = lastTime = time;
+               _logDetails::putVarint(block, baseTime);
+               if (writeTime == 0) writeTime = time;
+          }
+     }
+
+     ///Starts the message record
+     void beginMessage(std::uint64_t time, LogLevel level, unsigned int thread, StrViewA ident,
+                         unsigned int pattern) {
+          using namespace _logDetails;
+          unsigned int sid = sectionId(ident);
+          //threads can deliver messages slightly out of order
+          firstTime = std::min(firstTime, time);
+          lastTime = std::max(lastTime, time);
+          putVarint(block, binLogMessage);
+          putVarint(block, zigzag(static_cast<std::int64_t>(time - baseTime)));
+          putVarint(block, static_cast<unsigned int>(level));
+          putVarint(block, thread);
+          putVarint(block, sid);
+          putVarint(block, pattern);
+     }
+
+     ///Finishes the message record, writes block if needed
+     void endMessage(std::uint64_t time) {
+          if (block.size() >= blockSize || time >= writeTime + 1000000) {
+               flushBlock();
+               writeTime = time;
+          }
+     }
+
+     void writeText(std::uint64_t time, LogLevel level, unsigned int thread, StrViewA ident,
+                    const StrViewA *parts, std::size_t count) {
+          std::lock_guard<std::recursive_mutex> _(lock);
+          if (fd < 0) return;
+          beginBlock(time);
+          beginMessage(time, level, thread, ident, 0);
+          std::size_t len = 0;
+          for (std::size_t i = 0; i < count; i++) len += parts[i].length;
+          _logDetails::putVarint(block, len);
+          for (std::size_t i = 0; i < count; i++) block.append(parts[i].data, parts[i].length);
+          endMessage(time);
+     }
+
+     void writeCaptured(std::uint64_t time, LogLevel level, unsigned int thread, StrViewA ident,
+                    const char *data) {
+          using namespace _logDetails;
+          std::lock_guard<std::recursive_mutex> _(lock);
+          if (fd < 0) return;
+          const char *p = data;
+          auto desc = readCapturedValue<const CaptureDesc *>(p);
+          auto pattern = readCapturedValue<const char *>(p);
+          auto patlen = readCapturedValue<std::size_t>(p);
+          beginBlock(time);
+          unsigned int pid = patternId(pattern, patlen, desc);
+          beginMessage(time, level, thread, ident, pid);
+          for (const char *t = desc->types; *t; ++t) {
+               switch (*t) {
+               case 'b': putVarint(block, zigzag(readCapturedValue<std::int8_t>(p)));break;
+               case 'h': putVarint(block, zigzag(readCapturedValue<std::int16_t>(p)));break;
+               case 'i': putVarint(block, zigzag(readCapturedValue<std::int32_t>(p)));break;
+               case 'l': putVarint(block, zigzag(readCapturedValue<std::int64_t>(p)));break;
+               case 'B': putVarint(block, readCapturedValue<std::uint8_t>(p));break;
+               case 'H': putVarint(block, readCapturedValue<std::uint16_t>(p));break;
+               case 'I': putVarint(block, readCapturedValue<std::uint32_t>(p));break;
+               case 'L': putVarint(block, readCapturedValue<std::uint64_t>(p));break;
+               case 'p': putVarint(block, reinterpret_cast<std::uintptr_t>(readCapturedValue<const void *>(p)));break;
+               case 'f': {
+                    float v = readCapturedValue<float>(p);
+                    block.append(reinterpret_cast<const char *>(&v), sizeof(v));
+               } break;
+               case 'd': {
+                    double v = readCapturedValue<double>(p);
+                    block.append(reinterpret_cast<const char *>(&v), sizeof(v));
+               } break;
+               case 'D': {
+                    double v = static_cast<double>(readCapturedValue<long double>(p));
+                    block.append(reinterpret_cast<const char *>(&v), sizeof(v));
+               } break;
+               default: {
+                    StrViewA s = readCapturedString(p);
+                    putVarint(block, s.length);
+                    block.append(s.data, s.length);
+               } break;
+               }
+          }
+          endMessage(time);
+     }
+
+     ///Returns id of the pattern, defines the pattern in the current block
+     unsigned int patternId(const char *pattern, std::size_t len, const _logDetails::CaptureDesc *desc) {
+          using namespace _logDetails;
+          auto ins = patterns.emplace(PatternKey(pattern, desc), static_cast<unsigned int>(patterns.size()+1));
+          if (ins.second) {
+               std::size_t tlen = std::strlen(desc->types);
+               putVarint(block, binLogPattern);
+               putVarint(block, ins.first->second);
+               putVarint(block, len);
+               block.append(pattern, len);
+               putVarint(block, tlen);
+               block.append(desc->types, tlen);
+          }
+          return ins.first->second;
+     }
+
+     ///Returns id of the section, defines the section in the current block
+     unsigned int sectionId(StrViewA ident) {
+          using namespace _logDetails;
+          if (ident.empty()) return 0;
+          std::string key(ident);
+          auto iter = sections.find(key);
+          if (iter != sections.end()) return iter->second;
+          unsigned int id = static_cast<unsigned int>(sections.size()+1);
+          sections.emplace(std::move(key), id);
+          putVarint(block, binLogSection);
+          putVarint(block, id);
+          putVarint(block, ident.length);
+          block.append(ident.data, ident.length);
+          return id;
+     }
+
+     ///Writes the current block every second, or when the log rotation is requested
+     void flusherProc() {
+          std::unique_lock<std::mutex> lk(flushmx);
+          int ticks = 0;
+          while (!stopping) {
+               flushcond.wait_for(lk, std::chrono::milliseconds(100));
+               if (stopping) break;
+               if (++ticks < 10 && !AbstractLogProvider::rotated(rotateCounter)) continue;
+               ticks = 0;
+               lk.unlock();
+               {
+                    std::lock_guard<std::recursive_mutex> _(lock);
+                    flushBlock();
+                    writeTime = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                              std::chrono::system_clock::now().time_since_epoch()).count());
+               }
+               lk.lock();
+          }
+     }
+
+     void flushBlock() {
+          using namespace _logDetails;
+          if (block.empty() || fd < 0) return;
+          compressed.clear();
+          BinLogLZ::compress(block.data(), block.size(), compressed);
+          bool compr = compressed.size() < block.size();
+          const std::string &data = compr?compressed:block;
+          BinLogChunk chunk = {
+                    BinLogChunk::magicBlock,
+                    static_cast<std::uint32_t>(data.size()),
+                    static_cast<std::uint32_t>(block.size()),
+                    compr?1U:0U,
+                    firstTime, lastTime
+          };
+          //blocks are written at the fileEnd, so a block, which was written partially,
+          //is overwritten by the next block
+          if (binLogWrite(fd, &chunk, sizeof(chunk), fileEnd)
+                    && binLogWrite(fd, data.data(), data.size(), fileEnd + sizeof(chunk))) {
+               index.push_back(BinLogIndexEntry{fileEnd, firstTime, lastTime});
+               fileEnd += sizeof(chunk) + data.size();
+          } else {
+               //drop the partial block, the index is written at the fileEnd
+               int r = ::ftruncate(fd, static_cast<off_t>(fileEnd));
+               (void)r;
+          }
+          block.clear();
+          patterns.clear();
+          sections.clear();
+     }
+
+     void writeIndex() {
+          using namespace _logDetails;
+          std::size_t sz = index.size() * sizeof(BinLogIndexEntry);
+          BinLogChunk chunk = {
+                    BinLogChunk::magicIndex,
+                    static_cast<std::uint32_t>(sz),
+                    static_cast<std::uint32_t>(index.size()),
+                    0,
+                    index.empty()?0:index.front().firstTime,
+                    index.empty()?0:index.back().lastTime
+          };
+          BinLogTrailer trl;
+          trl.indexOffset = fileEnd;
+          std::memcpy(trl.magic, binLogTrailerMagic, sizeof(trl.magic));
+          std::uint64_t ofs = fileEnd;
+          binLogWrite(fd, &chunk, sizeof(chunk), ofs);
+          ofs += sizeof(chunk);
+          binLogWrite(fd, index.data(), sz, ofs);
+          ofs += sz;
+          binLogWrite(fd, &trl, sizeof(trl), ofs);
+          ofs += sizeof(trl);
+          //the trailer must be at the end of the file
+          int r = ::ftruncate(fd, static_cast<off_t>(ofs));
+          (void)r;
+     }
+};
+
+///Reads binary log written by BinLogFile
+class BinLogReader {
+public:
+
+     using Block = _logDetails::BinLogIndexEntry;
+
+     struct Message {
+          ///time in microseconds since epoch
+          std::uint64_t time;
+          LogLevel level;
+          unsigned int thread;
+          ///section identification (as in text log: "][name")
+          StrViewA section;
+          ///formatted text
+          std::string text;
+     };
+
+     BinLogReader() = default;
+     BinLogReader(const BinLogReader &) = delete;
+     BinLogReader &operator=(const BinLogReader &) = delete;
+     ~BinLogReader() {
+          if (fd >= 0) ::close(fd);
+     }
+
+     ///Opens the log and reads the index
+     /**
+      * @param pathname pathname of the file
+      * @return false, if the file cannot be opened or it is not a binary log
+      */
+     bool open(StrViewA pathname) {
+          using namespace _logDetails;
+          if (fd >= 0) ::close(fd);
+          fd = ::open(std::string(pathname).c_str(), O_RDONLY|O_CLOEXEC);
+          if (fd < 0) return false;
+          struct stat st;
+          char magic[sizeof(binLogFileMagic)];
+          if (::fstat(fd, &st) != 0
+                    || ::pread(fd, magic, sizeof(magic), 0) != sizeof(magic)
+                    || std::memcmp(magic, binLogFileMagic, sizeof(magic)) != 0) {
+               ::close(fd);
+               fd = -1;
+               return false;
+          }
+          binLogLoadIndex(fd, static_cast<std::uint64_t>(st.st_size), blocks);
+          return true;
+     }
+
+     ///Returns list of blocks (sparse time index)
+     const std::vector<Block> &getBlocks() const {
+          return blocks;
+     }
+
+     ///Reads messages in the time range
+     /**
+      * Only blocks, which can contain messages in the range, are read
+      *
+      * @param from time from (microseconds, inclusive)
+      * @param to time to (microseconds, inclusive)
+      * @param fn function, which receives const Message &. It returns true to continue
+      * or false to stop
+      * @return false, if corrupted block was found, otherwise true
+      */
+     template<typename Fn>
+     bool read(std::uint64_t from, std::uint64_t to, Fn &&fn) {
+          bool ok = true;
+          for (const Block &b: blocks) {
+               if (b.lastTime < from || b.firstTime > to) continue;
+               bool cont = true;
+               if (!readBlock(b.offset, [&](const Message &msg) {
+                    if (msg.time >= from && msg.time <= to) cont = fn(msg);
+                    return cont;
+               })) ok = false;
+               if (!cont) break;
+          }
+          return ok;
+     }
+
+     ///Formats message as the line of the text log
+     /**
+      * @param msg message
+      * @param out string, which receives the line (appended, without new line)
+      * @param subsecond include milliseconds
+      */
+     static void formatLine(const Message &msg, std::string &out, bool subsecond = false) {
+          std::time_t t = static_cast<std::time_t>(msg.time / 1000000);
+          out.append(_logDetails::LogDateCache::instance().get(t), 19);
+          if (subsecond) {
+               char ms[5];
+               ms[0] = '.';
+               unsignedToBuffer((msg.time / 1000) % 1000, ms+1, 10, 3);
+               out.append(ms, 4);
+          }
+          out.push_back(' ');
+          out.append(_logDetails::logLevelText(msg.level), 6);
+          char buff[numberBufferSize<unsigned int>()];
+          out.push_back('[');
+          out.append(buff, unsignedToBuffer(msg.thread, buff, 10, 4) - buff);
+          out.append(msg.section.data, msg.section.length);
+          out.append("] ");
+          out.append(msg.text);
+     }
+
+protected:
+
+     struct Pattern {
+          std::string text;
+          std::string types;
+     };
+
+     struct Arg {
+          char tag;
+          std::uint64_t u;
+          double d;
+          StrViewA s;
+     };
+
+     int fd = -1;
+     std::vector<Block> blocks;
+     std::string raw;
+     std::string data;
+     std::map<unsigned int, Pattern> patterns;
+     std::map<unsigned int, std::string> sections;
+     std::vector<Arg> args;
+
+     template<typename Fn>
+     bool readBlock(std::uint64_t offset, Fn &&fn) {
+          using namespace _logDetails;
+          BinLogChunk chunk;
+          if (::pread(fd, &chunk, sizeof(chunk), static_cast<off_t>(offset)) != sizeof(chunk)
+                    || chunk.magic != BinLogChunk::magicBlock) return false;
+          raw.resize(chunk.size);
+          if (::pread(fd, &raw[0], chunk.size, static_cast<off_t>(offset + sizeof(chunk))) != static_cast<ssize_t>(chunk.size)) return false;
+          if (chunk.compression == 1) {
+               if (!BinLogLZ::decompress(raw.data(), raw.size(), data, chunk.rawSize)) return false;
+          } else {
+               data = raw;
+          }
+          patterns.clear();
+          sections.clear();
+          const char *p = data.data();
+          const char *e = p + data.size();
+          Message msg;
+          std::uint64_t baseTime;
+          if (!getVarint(p, e, baseTime)) return false;
+          while (p != e) {
+               std::uint64_t type, id, len, v;
+               if (!getVarint(p, e, type)) return false;
+               switch (type) {
+               case binLogPattern: {
+                    Pattern pt;
+                    if (!getVarint(p, e, id) || !getString(p, e, pt.text) || !getString(p, e, pt.types)) return false;
+                    patterns[static_cast<unsigned int>(id)] = std::move(pt);
+               } break;
+               case binLogSection: {
+                    std::string s;
+                    if (!getVarint(p, e, id) || !getString(p, e, s)) return false;
+                    sections[static_cast<unsigned int>(id)] = std::move(s);
+               } break;
+               case binLogMessage: {
+                    std::uint64_t level, thread, sid, pid;
+                    if (!getVarint(p, e, v) || !getVarint(p, e, level) || !getVarint(p, e, thread)
+                         || !getVarint(p, e, sid) || !getVarint(p, e, pid)) return false;
+                    msg.time = baseTime + static_cast<std::uint64_t>(unzigzag(v));
+                    msg.level = static_cast<LogLevel>(level);
+                    msg.thread = static_cast<unsigned int>(thread);
+                    msg.section = sid?StrViewA(sections[static_cast<unsigned int>(sid)]):StrViewA();
+                    msg.text.clear();
+                    if (pid == 0) {
+                         if (!getVarint(p, e, len) || len > static_cast<std::size_t>(e - p)) return false;
+                         msg.text.append(p, len);
+                         p += len;
+                    } else {
+                         auto iter = patterns.find(static_cast<unsigned int>(pid));
+                         if (iter == patterns.end() || !readArgs(p, e, iter->second.types)) return false;
+                         formatMessage(iter->second.text, msg.text);
+                    }
+                    if (!fn(msg)) return true;
+               } break;
+               default:
+                    return false;
+               }
+          }
+          return true;
+     }
+
+     static bool getString(const char *&p, const char *e, std::string &out) {
+          std::uint64_t len;
+          if (!_logDetails::getVarint(p, e, len) || len > static_cast<std::size_t>(e - p)) return false;
+          out.assign(p, len);
+          p += len;
+          return true;
+     }
+
+     bool readArgs(const char *&p, const char *e, const std::string &types) {
+          using namespace _logDetails;
+          args.clear();
+          for (char t: types) {
+               Arg a;
+               a.tag = t;
+               a.u = 0;
+               a.d = 0;
+               switch (t) {
+               case 'b': case 'h': case 'i': case 'l':
+               case 'B': case 'H': case 'I': case 'L': case 'p':
+                    if (!getVarint(p, e, a.u)) return false;
+                    break;
+               case 'f': {
+                    float f;
+                    if (e - p < static_cast<std::ptrdiff_t>(sizeof(f))) return false;
+                    std::memcpy(&f, p, sizeof(f));
+                    p += sizeof(f);
+                    a.d = f;
+               } break;
+               case 'd': case 'D':
+                    if (e - p < static_cast<std::ptrdiff_t>(sizeof(a.d))) return false;
+                    std::memcpy(&a.d, p, sizeof(a.d));
+                    p += sizeof(a.d);
+                    break;
+               default: {
+                    std::uint64_t len;
+                    if (!getVarint(p, e, len) || len > static_cast<std::size_t>(e - p)) return false;
+                    a.s = StrViewA(p, len);
+                    p += len;
+               } break;
+               }
+               args.push_back(a);
+          }
+          return true;
+     }
+
+     ///Formats message with the same rules as logFormat
+     void formatMessage(const std::string &pattern, std::string &out) {
+          using namespace _logDetails;
+          StringWriter wr(out);
+          std::size_t pos = 0;
+          while (pos < pattern.size()) {
+               PatternSegment seg = readPatternSegment(pattern.data(), pattern.size(), pos);
+               if (!seg.placeholder) {
+                    out.append(pattern.data()+seg.pos, seg.len);
+               } else if (!seg.error && seg.arg >= 1 && seg.arg <= args.size()) {
+                    const Arg &a = args[seg.arg-1];
+                    switch (a.tag) {
+                    case 'b': case 'h': case 'i': case 'l':
+                         logPrintValue(wr, static_cast<long long>(unzigzag(a.u)));break;
+                    case 'B': case 'H': case 'I': case 'L':
+                         logPrintValue(wr, static_cast<unsigned long long>(a.u));break;
+                    case 'p':
+                         logPrintValue(wr, reinterpret_cast<const void *>(static_cast<std::uintptr_t>(a.u)));break;
+                    case 'f':
+                         logPrintValue(wr, static_cast<float>(a.d));break;
+                    case 'd': case 'D':
+                         logPrintValue(wr, a.d);break;
+                    default:
+                         logPrintValue(wr, a.s);break;
+                    }
+               }
+          }
+     }
+};
+
+
+}
+
+
+#endif /* _ONDRA_SHARED_BINLOG_H_72390481723094 */
@@ -9,6 +9,8 @@
 #define SRC_ONDRA_SHARED_CALLBACK_H_78946548694984654
 
 #include <memory>
+#include <new>
+#include <type_traits>
 #include <typeinfo>
 
 #include "fastsharedalloc.h"
@@ -44,8 +46,31 @@ template<typename T> class Callback;
 
 template<typename R, typename ... Args>
 class Callback<R(Args...)> {
+protected:
+    class AbstractCall;
+    template<typename Fn> class FnCall;
 public:
 
+    ///Size of the inline buffer
+    /**
+     * Function objects up to this size are stored inside of the Callback object. The size
+     * is enough to hold a pointer to an object (raw or shared) with a pointer to a member
+     * function, or a lambda function which captures few pointers
+     */
+    static constexpr std::size_t inline_size = 6*sizeof(void *);
+
+    ///Trait - determines whether given function object is stored inline (without allocation)
+    /**
+     * @code
+     * static_assert(Callback<void(int)>::fits_inline<decltype(fn)>::value, "Too large");
+     * @endcode
+     */
+    template<typename Fn>
+    using fits_inline = std::integral_constant<bool,
+            sizeof(FnCall<typename std::decay<Fn>::type>) <= inline_size
+            && alignof(FnCall<typename std::decay<Fn>::type>) <= alignof(std::max_align_t)
+            && std::is_nothrow_move_constructible<typename std::decay<Fn>::type>::value>;
+
     ///Construct empty callback object. You can assign later
     Callback() {}
     ///Assign nullptr to callback creates unitialized callback
@@ -72,10 +97,14 @@ public:
     /**
      * @param ptr pointer to object. It is not limited to raw pointer. It can be a smart pointer as well
      * @param fn pointer to member function of the object
+     *
+     * @note binding of a raw or a shared pointer doesn't allocate memory
      */
-    template<typename Ptr, typename Obj, typename ... MArgs, typename = decltype((std::declval<Ptr>()->*(std::declval<R (Obj::*)(MArgs ...)>()))(std::declval<Args>()...))>
+    template<typename Ptr, typename Obj, typename ... MArgs, typename = decltype(((*std::declval<Ptr>()).*(std::declval<R (Obj::*)(MArgs ...)>()))(std::declval<Args>()...))>
     Callback(Ptr &&ptr, R (Obj::*fn)(MArgs ... args));
 
+    ~Callback() {reset();}
+
     ///Call the function
     /**
      * @param args function arguments
@@ -89,29 +118,42 @@ public:
     bool operator!=(std::nullptr_t) const {return ptr != nullptr;}
 
     ///Clear assigned function
-    void reset() {ptr = nullptr;}
+    void reset();
 
 protected:
 
     class AbstractCall:public FastSharedAlloc {
     public:
         virtual R call(Callback &me, FastParam<Args>  ... args)  = 0;
+        ///Move the object to other buffer - used only for inline objects
+        virtual AbstractCall *move_to(void *buffer) noexcept = 0;
         virtual ~AbstractCall() {}
     };
 
-    using Ptr_t = std::unique_ptr<AbstractCall>;
+    ///Points to the function object, either to the buffer or to the heap
+    AbstractCall *ptr = nullptr;
+    ///Inline buffer
+    typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type buffer;
 
-    Ptr_t ptr;
+    bool is_inline() const {
+        return static_cast<const void *>(ptr) == static_cast<const void *>(&buffer);
+    }
 
 
     template<typename Fn>
     class FnCall: public AbstractCall {
     public:
-        FnCall(Fn &&fn):fn(std::forward<Fn>(fn)) {}
+        template<typename X>
+        FnCall(X &&fn):fn(std::forward<X>(fn)) {}
 
         virtual R call(Callback &, FastParam<Args>  ... args) override {
             return fn(std::forward<FastParam<Args> >(args)...);
         }
+        virtual AbstractCall *move_to(void *buffer) noexcept override {
+            AbstractCall *r = ::new(buffer) FnCall(std::move(fn));
+            this->~FnCall();
+            return r;
+        }
 
     protected:
         Fn fn;
@@ -120,38 +162,62 @@ protected:
     template<typename Fn>
     class FnCallWithMe: public AbstractCall {
     public:
-        FnCallWithMe(Fn &&fn):fn(std::forward<Fn>(fn)) {}
+        template<typename X>
+        FnCallWithMe(X &&fn):fn(std::forward<X>(fn)) {}
 
         virtual R call(Callback &me, FastParam<Args>  ... args) override {
             return fn(me, args...);
         }
+        virtual AbstractCall *move_to(void *buffer) noexcept override {
+            AbstractCall *r = ::new(buffer) FnCallWithMe(std::move(fn));
+            this->~FnCallWithMe();
+            return r;
+        }
 
     protected:
         Fn fn;
     };
 
+    template<typename Call, typename Fn>
+    void construct(Fn &&fn, std::true_type) {
+        ptr = ::new(&buffer) Call(std::forward<Fn>(fn));
+    }
+    template<typename Call, typename Fn>
+    void construct(Fn &&fn, std::false_type) {
+        ptr = new Call(std::forward<Fn>(fn));
+    }
 
     template<typename Fn>
-    static auto make(Fn &&fn)
-        -> decltype(std::declval<Fn>()(std::declval<Args>()...),Ptr_t()) {
-        return std::make_unique<FnCall<Fn> >(std::forward<Fn>(fn));
+    auto make(Fn &&fn)
+        -> decltype(std::declval<Fn>()(std::declval<Args>()...),void()) {
+        construct<FnCall<typename std::decay<Fn>::type> >(std::forward<Fn>(fn), fits_inline<Fn>());
     }
     template<typename Fn>
-    static auto make(Fn &&fn)
-        -> decltype(std::declval<Fn>()(std::declval<Callback &>(), std::declval<Args>()...),Ptr_t()) {
-        return std::make_unique<FnCallWithMe<Fn> >(std::forward<Fn>(fn));
+    auto make(Fn &&fn)
+        -> decltype(std::declval<Fn>()(std::declval<Callback &>(), std::declval<Args>()...),void()) {
+        construct<FnCallWithMe<typename std::decay<Fn>::type> >(std::forward<Fn>(fn), fits_inline<Fn>());
+    }
+
+    void take(Callback &other) noexcept {
+        if (other.is_inline()) {
+            ptr = other.ptr->move_to(&buffer);
+        } else {
+            ptr = other.ptr;
+        }
+        other.ptr = nullptr;
     }
 };
 
 template<typename R, typename ... Args>
-Callback<R(Args...)>::Callback(Callback &&other)
-    :ptr(std::move(other.ptr)) {}
+Callback<R(Args...)>::Callback(Callback &&other) {
+    take(other);
+}
 
 template<typename R, typename ... Args>
 template<typename Ptr, typename Obj, typename ... MArgs, typename >
 Callback<R(Args...)>::Callback(Ptr &&ptr, R (Obj::*fn)(MArgs ... args))
-:Callback([ptr = Ptr(std::forward<Ptr>(ptr)),fn](FastParam<Args> ... args) {
-    (ptr->*fn)(args...);
+:Callback([ptr = typename std::decay<Ptr>::type(std::forward<Ptr>(ptr)),fn](FastParam<Args> ... args) noexcept(false) -> R {
+    return ((*ptr).*fn)(args...);
 })
 {}
 
@@ -159,7 +225,8 @@ Callback<R(Args...)>::Callback(Ptr &&ptr, R (Obj::*fn)(MArgs ... args))
 template<typename R, typename ... Args>
 Callback<R(Args...)> &Callback<R(Args...)>::operator=(Callback &&other) {
     if (this != &other) {
-        ptr = std::move(other.ptr);
+        reset();
+        take(other);
     }
     return *this;
 }
@@ -167,8 +234,18 @@ Callback<R(Args...)> &Callback<R(Args...)>::operator=(Callback &&other) {
 template<typename R, typename ... Args>
 template<typename Fn>
 Callback<R(Args...)>::Callback(Fn &&fn)
-    :ptr(make(std::forward<Fn>(fn)))
-{}
+{
+    make(std::forward<Fn>(fn));
+}
+
+template<typename R, typename ... Args>
+void Callback<R(Args...)>::reset() {
+    if (ptr) {
+        if (is_inline()) ptr->~AbstractCall();
+        else delete ptr;
+        ptr = nullptr;
+    }
+}
 
 template<typename R, typename ... Args>
 R Callback<R(Args...)>::operator()(FastParam<Args> ... args) const {
@@ -7,9 +7,11 @@
 
 #ifndef ONDRA_SHARED_CMDLINE_H_20190238102938109
 #define ONDRA_SHARED_CMDLINE_H_20190238102938109
+#include <cstring>
 #include <string>
 #include <iostream>
 #include "filesystem.h"
+#include "fromString.h"
 #include <optional>
 
 namespace ondra_shared {
@@ -196,24 +198,19 @@ inline std::optional<std::uintptr_t> CmdArgIter::getUInt(PString k)  {
      std::optional<std::uintptr_t> ov;
      if (!k) return ov;
 
-     uintptr_t v = 0;
-     uintptr_t b = 10;
-     while (*k) {
-          char c = *k;
-          if (c == 'x' && v == 0) b = 16;
-          else if (c == 'b' && v == 0) b = 2;
-          else if (c == 'o' && v == 0) b = 8;
-          else {
-               uintptr_t z;
-               if (std::isdigit(c)) z = c - '0';
-               else if (std::isalpha(c)) z = std::toupper(c) - 'A' + 10;
-               else return ov;
-               if (z >= b) return ov;
-               v = v * b + z;
-          }
-          ++k;
+     //prefix can be 0x, 0b, 0o, or just x, b, o
+     if (k[0] == '0' && k[1] && std::strchr("xbo", k[1])) ++k;
+     int b = 10;
+     switch (*k) {
+          case 'x': b = 16; ++k; break;
+          case 'b': b = 2; ++k; break;
+          case 'o': b = 8; ++k; break;
+          default: break;
      }
-     ov = v;
+     const char *e = k + std::strlen(k);
+     uintptr_t v;
+     auto r = unsignedFromString(k, e, v, b);
+     if (r && r.ptr == e) ov = v;
      return ov;
 }
 
@@ -222,13 +219,15 @@ inline std::optional<std::intptr_t> CmdArgIter::getInt()  {
      std::optional<std::intptr_t> ov;
      if (!k) return ov;
 
+     constexpr std::uintptr_t maxv = static_cast<std::uintptr_t>(std::numeric_limits<std::intptr_t>::max());
      if (*k == '-') {
           auto v = getUInt(k+1);
-          return -static_cast<intptr_t>(*v);
+          if (v && *v <= maxv + 1) ov = *v?-static_cast<intptr_t>(*v - 1) - 1:0;
      } else {
           auto v = getUInt(k);
-          return static_cast<intptr_t>(*v);
+          if (v && *v <= maxv) ov = static_cast<intptr_t>(*v);
      }
+     return ov;
 
 }
 
@@ -237,9 +236,10 @@ inline std::optional<double>  CmdArgIter::getNumber()  {
      std::optional<double> ov;
      if (!k) return ov;
 
-     char *z;
-     double v = std::strtod(k,&z);
-     if (*z == 0) ov = v;
+     const char *e = k + std::strlen(k);
+     double v;
+     auto r = floatFromString(k, e, v);
+     if (r && r.ptr == e) ov = v;
      return ov;
 }
 
@@ -78,7 +78,8 @@ public:
                                    debug?StrViewA(""):logcfg["level"].getString(""),
                                    LogLevel::debug,
                                    logcfg["rotation"].getUInt(7),
-                                   logcfg["interval"].getUInt(86400));
+                                   logcfg["interval"].getUInt(86400),
+                                   logcfg["size"].getUInt(0));
                logProvider->setDefault();
                return true;
 
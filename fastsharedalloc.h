@@ -8,6 +8,14 @@
 #ifndef SRC_SHARED_FASTSHAREDALLOC_H_
 #define SRC_SHARED_FASTSHAREDALLOC_H_
 #include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <type_traits>
+#ifdef _WIN32
+#include <malloc.h>
+#endif
 
 
 namespace ondra_shared {
@@ -15,120 +23,416 @@ namespace ondra_shared {
 ///Allocator optimized rapid allocation and deallocation many of small objects, such a callbacks
 /**
  * Allocator uses cache of deallocated objects to reuse them during next allocation.
- * There are 16 caches. Size of objects are in granuality of 4x size of void (16b for 32bit,32b for 64bit).
- * Maximum cacheable block is 16*4*sizeof(void) (256b for 32bit, 512 for 64bit)
+ * There are 32 caches. First 16 caches have granuality of 4x size of void (16b for 32bit,32b for 64bit),
+ * up to 16*4*sizeof(void) (256b for 32bit, 512 for 64bit). Next 16 caches are geometric, there
+ * are 4 sizes for each doubling of the size. Maximum cacheable block is 16x larger than
+ * the maximum of linear part (4096b for 32bit, 8192b for 64bit). Larger blocks are allocated
+ * by the standard allocator
  *
- * There is no limit how many block can be cached. However cached block can occupy significant
- * part of memory. In this case, you can call ::gc() to free any cached memory.
+ * Blocks are not allocated separately. Allocator allocates slabs (at least one page, at most
+ * 64KB) and carves them into blocks. Slab is released (returned to the standard allocator)
+ * once all its blocks are released from the cache (see gc())
+ *
+ * By default, there is no limit how many block can be cached. However cached block can occupy significant
+ * part of memory. In this case, you can call ::gc() to free any cached memory. You can also
+ * limit count of cached blocks per size class (setCacheLimit()), blocks above the limit are
+ * released immediately. Function trim() releases half of cached blocks, it is intended
+ * to be called periodically, so unused blocks are released over time
+ *
+ * @code
+ * sch.each(std::chrono::seconds(10)) >> []{FastSharedAlloc::trim();};
+ * @endcode
+ *
+ * Statistics of every size class are available through the function getStats(). Counters are
+ * updated when blocks are moved between the global cache and the thread caches, so reading
+ * them doesn't need any locking. Blocks held by the thread caches are not counted as cached
+ *
+ * Every thread has own small cache (magazine) for every size. Allocations and deallocations
+ * are served from the magazine without writing to shared state. When magazine is empty, it
+ * is refilled by a batch of blocks from the global cache. When it is full, half of
+ * blocks is returned to the global cache in one step. Blocks released by other thread
+ * return to the global cache this way and they are picked by the thread during next refill.
+ * When thread exits, its magazines are returned to the global cache. Functions trim() and gc()
+ * ask every thread to return its magazines, the thread does this during its next
+ * allocation or deallocation
  *
  * To use this object, you need just to inherit this object. Derived object is then able to use
  * customized new and delete operators
  *
  */
 class FastSharedAlloc {
+public:
 
+    ///Statistics of a size class
+    struct ClassStats {
+        ///size of block
+        std::size_t block_size;
+        ///count of blocks allocated from the standard allocator (carved from slabs)
+        std::size_t allocated;
+        ///count of blocks in the global cache
+        std::size_t cached;
+        ///count of blocks reused from the global cache
+        std::size_t reused;
+        ///count of blocks released from the cache (due limit, trim or gc)
+        std::size_t released;
+        ///current limit of cached blocks
+        std::size_t limit;
+    };
 
-    static constexpr std::size_t levelStep = sizeof(void *)*4;
+protected:
 
+    static constexpr std::size_t levelStep = sizeof(void *)*4;
+    ///count of linear levels
+    static constexpr int linearLevels = 16;
+    ///total count of levels
+    static constexpr int levels = 32;
+    ///largest block of linear levels
+    static constexpr std::size_t linearMax = levelStep*linearLevels;
+
+    ///Calculates level for given size
+    /**
+     * @param x size
+     * @return level, or zero if size is too large
+     */
     static constexpr int sizeToLevel(std::size_t x) {
-        return static_cast<int>((x + levelStep-1)/levelStep);
+        if (x <= linearMax) return static_cast<int>((x + levelStep-1)/levelStep);
+        std::size_t d = linearMax;
+        int lvl = linearLevels;
+        while (x > 2*d) {
+            d *= 2;
+            lvl += 4;
+        }
+        std::size_t step = d/4;
+        lvl += static_cast<int>((x - d + step - 1)/step);
+        return lvl > levels?0:lvl;
     }
 
-    static constexpr std::size_t stepToLevel(int x) {
-        return x = (x + levelStep-1)/levelStep;
+    ///Calculates block size of given level
+    static constexpr std::size_t levelToSize(int level) {
+        if (level <= linearLevels) return levelStep*level;
+        int g = (level - linearLevels - 1) / 4;
+        int r = (level - linearLevels - 1) % 4 + 1;
+        std::size_t d = linearMax << g;
+        return d + r * (d/4);
+    }
+
+    ///Header of the slab, placed at beginning of the slab
+    struct alignas(64) SlabHeader {
+        ///count of blocks which were not yet released from the cache
+        std::atomic<std::size_t> live;
+    };
+
+    ///Maximum size of a slab
+    static constexpr std::size_t maxSlabSize = 65536;
+
+    ///Calculates size of a slab for given block size
+    /** Slab is always power of two, because it is also aligned to its size. It
+     * contains 16 blocks, but it is not larger than maxSlabSize */
+    static constexpr std::size_t slabSize(std::size_t blk_size) {
+        std::size_t s = 4096;
+        while (s < blk_size * 16 + sizeof(SlabHeader) && s < maxSlabSize) s <<= 1;
+        return s;
+    }
+
+    ///Allocates memory of the slab aligned to its size
+    static void *allocSlabMemory(std::size_t size) {
+#ifdef _WIN32
+        void *mem = _aligned_malloc(size, size);
+        if (mem == nullptr) throw std::bad_alloc();
+#else
+        void *mem;
+        if (posix_memalign(&mem, size, size)) throw std::bad_alloc();
+#endif
+        return mem;
+    }
+
+    ///Releases memory of the slab
+    static void freeSlabMemory(void *mem) {
+#ifdef _WIN32
+        _aligned_free(mem);
+#else
+        std::free(mem);
+#endif
     }
 
     struct BlockBase {
     };
 
-    struct BlockBase2: public BlockBase {
+    ///Holds flags stored in the chain. It is template, so the flags can be defined in the header
+    template<typename = void>
+    struct BlockBase2T: public BlockBase {
         static constexpr BlockBase dummy_shutdown = {};
         static constexpr BlockBase dummy_busy = {};
         static constexpr BlockBase const *shutdown_flag = &dummy_shutdown;
         static constexpr BlockBase const *busy_flag = &dummy_busy;
     };
 
+    using BlockBase2 = BlockBase2T<>;
+
     template<int level>
     struct Block: public BlockBase2 {
-        static constexpr std::size_t blk_size = levelStep*level;
+        static constexpr std::size_t blk_size = levelToSize(level);
         Block *next = nullptr;
         char reserved[blk_size - sizeof(Block *)];
     };
 
+    ///Per thread cache of blocks of one size
+    struct Magazine {
+        void *head = nullptr;
+        unsigned int count = 0;
+    };
+
+    ///maximum count of blocks moved between the magazine and the global cache in one step
+    static constexpr unsigned int magazine_batch = 16;
+    ///maximum bytes moved between the magazine and the global cache in one step
+    static constexpr std::size_t magazine_batch_bytes = 16384;
+
+    ///Calculates count of blocks moved in one step for given block size
+    /** Large blocks are moved in smaller batches, so the magazine doesn't hold too much memory */
+    static constexpr unsigned int magazineBatch(std::size_t blk_size) {
+        return blk_size * magazine_batch <= magazine_batch_bytes?magazine_batch
+                :blk_size >= magazine_batch_bytes?1
+                :static_cast<unsigned int>(magazine_batch_bytes / blk_size);
+    }
+
     template<int level>
     class Chain {
     public:
         using Blk = Block<level>;
         using BlkPtr = Blk *;
 
-        void *alloc() {
+        static constexpr std::size_t slab_size = slabSize(Blk::blk_size);
+        ///count of blocks moved between the magazine and the global cache in one step
+        static constexpr unsigned int mag_batch = magazineBatch(Blk::blk_size);
+        ///maximum count of blocks in the magazine
+        static constexpr unsigned int mag_capacity = 4*mag_batch;
+
+        Chain():blk_stack(nullptr),limit(static_cast<std::size_t>(-1)) {}
+
+        ///Allocate using the thread's magazine
+        void *alloc(Magazine &m) {
+            if (m.head == nullptr) {
+                m.head = alloc_batch(mag_batch, m.count);
+                if (m.head == nullptr) {
+                    m.head = alloc_slab(m.count);
+                    //keep only one batch, rest of the slab is available to other threads
+                    if (m.count > mag_batch) {
+                        flush(m, m.count - mag_batch);
+                    }
+                }
+            }
+            BlkPtr out = reinterpret_cast<BlkPtr>(m.head);
+            m.head = out->next;
+            --m.count;
+            return out;
+        }
+
+        ///Free using the thread's magazine
+        void free(void *ptr, Magazine &m) {
+            BlkPtr p = reinterpret_cast<BlkPtr>(ptr);
+            p->next = reinterpret_cast<BlkPtr>(m.head);
+            m.head = p;
+            if (++m.count > mag_capacity) {
+                flush(m, mag_batch*2);
+            }
+        }
+
+        ///Return blocks from magazine to the global cache
+        /**
+         * @param m magazine
+         * @param count count of blocks to return
+         */
+        void flush(Magazine &m, unsigned int count) {
+            if (m.head == nullptr || count == 0) return;
+            BlkPtr first = reinterpret_cast<BlkPtr>(m.head);
+            BlkPtr last = first;
+            unsigned int n = 1;
+            while (n < count && last->next) {
+                last = last->next;
+                ++n;
+            }
+            m.head = last->next;
+            m.count -= n;
+            free_batch(first, last, n);
+        }
+
+        ///Take up to count blocks from the global cache
+        /**
+         * @param count count of blocks to take
+         * @param taken receives count of blocks taken
+         * @return list of blocks or nullptr, if there is no cached block
+         */
+        BlkPtr alloc_batch(unsigned int count, unsigned int &taken) {
+            taken = 0;
             //lock the queue - putting busy flag there
             BlkPtr busy_flg = static_cast<BlkPtr>(const_cast<BlockBase *>(BlockBase2::busy_flag));
             //also unshare current chain (so nobody will access it)
             BlkPtr nx = blk_stack.exchange(busy_flg);
             //if we got the busy_flag, queue is already locked, wait until unlocked - spinlock
             while (nx == busy_flg) {
-                //put busy flag to the queue and receive content
                 nx = blk_stack.exchange(busy_flg);
             }
             //if received shutdown flag or nullptr
             if (nx ==Blk::shutdown_flag || nx == nullptr) {
                 //put it back (if there is still busy_flg)
                 blk_stack.compare_exchange_strong(busy_flg, nx);
-                //do standard allocation
-                return ::operator new(Blk::blk_size);
+                return nullptr;
             }
-            //store top most block
             BlkPtr out = nx;
-            //make new root (of next)
-            nx = out->next;
+            BlkPtr last = nx;
+            taken = 1;
+            while (taken < count && last->next) {
+                last = last->next;
+                ++taken;
+            }
+            nx = last->next;
+            last->next = nullptr;
+            cached.fetch_sub(taken, std::memory_order_relaxed);
+            reused.fetch_add(taken, std::memory_order_relaxed);
             //put the new root to the top - there should be busy flag a the time;
             if (!blk_stack.compare_exchange_strong(busy_flg, nx)) {
                 //if there were something else, we cannot put rest of list back
                 //free rest of blocks
-                while (nx) {
-                    BlkPtr d = nx;
-                    nx = nx->next;
-                    ::operator delete(d);
-                }
+                cached.fetch_sub(release_list(nx), std::memory_order_relaxed);
             }
-            //return our block
             return out;
         }
 
-        void free(void *ptr) {
-            //convert ptr to block
-            BlkPtr p = reinterpret_cast<BlkPtr>(ptr);
-            //load top of chain
-            p->next = blk_stack.load();;
+        ///Put list of blocks to the global cache
+        /**
+         * @param first first block
+         * @param last last block
+         * @param count count of blocks
+         */
+        void free_batch(BlkPtr first, BlkPtr last, std::size_t count) {
+            //if limit would be exceeded, release blocks
+            if (cached.load(std::memory_order_relaxed) + count > limit.load(std::memory_order_relaxed)) {
+                last->next = nullptr;
+                release_list(first);
+                return;
+            }
+            cached.fetch_add(count, std::memory_order_relaxed);
+            last->next = blk_stack.load();
             do {
-                //if top is shutdown, we need to deallocate by operator
-                if (p->next == Blk::shutdown_flag) {
-                    ::operator delete(ptr);
+                //if top is shutdown, we need to release blocks
+                if (last->next == Blk::shutdown_flag) {
+                    last->next = nullptr;
+                    cached.fetch_sub(release_list(first), std::memory_order_relaxed);
                     return;
                 }
                 //if top is busy, we must wait in spin lock, so replace next with nullptr
-                if (p->next == Blk::busy_flag) {
-                    p->next = nullptr;
+                if (last->next == Blk::busy_flag) {
+                    last->next = nullptr;
                 }
-                //try to replace top with out block
-            } while(!blk_stack.compare_exchange_weak(p->next, p));
+            } while(!blk_stack.compare_exchange_weak(last->next, first));
+        }
+
+        ///Allocate without the magazine
+        void *alloc() {
+            unsigned int cnt;
+            BlkPtr out = alloc_batch(1, cnt);
+            if (out) return out;
+            out = alloc_slab(cnt);
+            BlkPtr rest = out->next;
+            if (rest) {
+                BlkPtr last = rest;
+                while (last->next) last = last->next;
+                free_batch(rest, last, cnt-1);
+            }
+            return out;
+        }
+
+        ///Free without the magazine
+        void free(void *ptr) {
+            BlkPtr p = reinterpret_cast<BlkPtr>(ptr);
+            p->next = nullptr;
+            free_batch(p, p, 1);
+        }
+
+        ///Allocate new slab and carve it into blocks
+        /**
+         * @param count receives count of blocks
+         * @return list of blocks
+         */
+        BlkPtr alloc_slab(unsigned int &count) {
+            void *mem = allocSlabMemory(slab_size);
+            constexpr std::size_t n = (slab_size - sizeof(SlabHeader))/Blk::blk_size;
+            new(mem) SlabHeader{{n}};
+            char *beg = reinterpret_cast<char *>(mem) + sizeof(SlabHeader);
+            BlkPtr lst = nullptr;
+            for (std::size_t i = n; i > 0; --i) {
+                BlkPtr b = reinterpret_cast<BlkPtr>(beg + (i-1) * Blk::blk_size);
+                b->next = lst;
+                lst = b;
+            }
+            count = static_cast<unsigned int>(n);
+            allocated.fetch_add(n, std::memory_order_relaxed);
+            return lst;
+        }
+
+        ///Release list of blocks
+        /**
+         * @param lst list of blocks
+         * @return count of released blocks
+         */
+        std::size_t release_list(BlkPtr lst) {
+            std::size_t n = 0;
+            while (lst) {
+                BlkPtr d = lst;
+                lst = lst->next;
+                release_block(d);
+                ++n;
+            }
+            released.fetch_add(n, std::memory_order_relaxed);
+            return n;
+        }
+
+        ///Release block from the cache. Releases the slab, if it was last block
+        static void release_block(void *ptr) {
+            auto addr = reinterpret_cast<std::uintptr_t>(ptr) & ~static_cast<std::uintptr_t>(slab_size-1);
+            SlabHeader *h = reinterpret_cast<SlabHeader *>(addr);
+            if (h->live.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                h->~SlabHeader();
+                freeSlabMemory(h);
+            }
         }
 
         void shutdown() {
             BlkPtr sht = const_cast<BlkPtr>(static_cast<const Blk *>(Blk::shutdown_flag));
             BlkPtr x = blk_stack.exchange(sht);
             //if we received busy_flag - some other thread is responsible to free the chain
-            if (x != Blk::busy_flag || x != Blk::shutdown_flag) {
-                while (x) {
-                    BlkPtr z = x;
-                    x=x->next;
-                    ::operator delete(z);
-                }
+            if (x != Blk::busy_flag && x != Blk::shutdown_flag) {
+                cached.fetch_sub(release_list(x), std::memory_order_relaxed);
             }
 
         }
 
+        ///Release half of cached blocks
+        void trim() {
+            std::size_t c = cached.load(std::memory_order_relaxed);
+            if (c < 2) return;
+            unsigned int taken;
+            BlkPtr lst = alloc_batch(static_cast<unsigned int>(c/2), taken);
+            //these blocks were not reused
+            reused.fetch_sub(taken, std::memory_order_relaxed);
+            release_list(lst);
+        }
+
+        ClassStats get_stats() const {
+            return {
+                Blk::blk_size,
+                allocated.load(std::memory_order_relaxed),
+                cached.load(std::memory_order_relaxed),
+                reused.load(std::memory_order_relaxed),
+                released.load(std::memory_order_relaxed),
+                limit.load(std::memory_order_relaxed)
+            };
+        }
+
+        void set_limit(std::size_t blocks) {
+            limit.store(blocks, std::memory_order_relaxed);
+        }
+
         void restart() {
             BlkPtr sht = const_cast<BlkPtr>(static_cast<const Blk *>(Blk::shutdown_flag));
             blk_stack.compare_exchange_strong(sht, nullptr);
@@ -137,11 +441,51 @@ class FastSharedAlloc {
 
     protected:
         std::atomic<BlkPtr> blk_stack;
+        std::atomic<std::size_t> allocated = {0};
+        std::atomic<std::size_t> cached = {0};
+        std::atomic<std::size_t> reused = {0};
+        std::atomic<std::size_t> released = {0};
+        std::atomic<std::size_t> limit;
+    };
+
+    class Allocator;
+
+    ///Magazines of the current thread
+    class ThreadCache {
+    public:
+        Magazine mags[levels];
+        ///flush epoch seen by this thread (see Allocator::requestFlush())
+        unsigned int epoch = 0;
+
+        ThreadCache();
+        ~ThreadCache();
+        ThreadCache(const ThreadCache &) = delete;
+        ThreadCache &operator=(const ThreadCache &) = delete;
+
+        ///Retrieve cache of current thread
+        /**
+         * @return pointer to cache, or nullptr, if the cache of the thread has been already destroyed
+         */
+        static ThreadCache *get() {
+            if (state() == destroyed) return nullptr;
+            static thread_local ThreadCache tc;
+            return &tc;
+        }
+    protected:
+        static constexpr char not_created = 0;
+        static constexpr char alive = 1;
+        static constexpr char destroyed = 2;
+        static char &state() {
+            static thread_local char st = not_created;
+            return st;
+        }
     };
 
     class Allocator {
     public:
 
+        ///Incremented when thread caches should be returned to the global cache
+        alignas(64) std::atomic<unsigned int> flushEpoch = {0};
 
         Chain<1> blk01;
         Chain<2> blk02;
@@ -159,6 +503,22 @@ class FastSharedAlloc {
         Chain<14> blk14;
         Chain<15> blk15;
         Chain<16> blk16;
+        Chain<17> blk17;
+        Chain<18> blk18;
+        Chain<19> blk19;
+        Chain<20> blk20;
+        Chain<21> blk21;
+        Chain<22> blk22;
+        Chain<23> blk23;
+        Chain<24> blk24;
+        Chain<25> blk25;
+        Chain<26> blk26;
+        Chain<27> blk27;
+        Chain<28> blk28;
+        Chain<29> blk29;
+        Chain<30> blk30;
+        Chain<31> blk31;
+        Chain<32> blk32;
 
         template<typename Fn>
         bool chooseChain(int id, Fn &&fn) {
@@ -179,6 +539,22 @@ class FastSharedAlloc {
             case 14: fn(blk14); return true;
             case 15: fn(blk15); return true;
             case 16: fn(blk16); return true;
+            case 17: fn(blk17); return true;
+            case 18: fn(blk18); return true;
+            case 19: fn(blk19); return true;
+            case 20: fn(blk20); return true;
+            case 21: fn(blk21); return true;
+            case 22: fn(blk22); return true;
+            case 23: fn(blk23); return true;
+            case 24: fn(blk24); return true;
+            case 25: fn(blk25); return true;
+            case 26: fn(blk26); return true;
+            case 27: fn(blk27); return true;
+            case 28: fn(blk28); return true;
+            case 29: fn(blk29); return true;
+            case 30: fn(blk30); return true;
+            case 31: fn(blk31); return true;
+            case 32: fn(blk32); return true;
             default: return false;
             }
         }
@@ -190,30 +566,71 @@ class FastSharedAlloc {
         ///shutdown allocator
         /** Method itself is not MT safe, it is MT safe relative to alloc/dealloc */
         void shutdown() {
-            for (int i = 0; i < 16; i++) {
+            for (int i = 0; i < levels; i++) {
                 chooseChain(i+1, [&](auto &c){c.shutdown();});
             }
         }
 
+        ///Return all blocks from the thread cache to the global cache
+        void flush(ThreadCache &tc) {
+            for (int i = 0; i < levels; i++) {
+                Magazine &m = tc.mags[i];
+                chooseChain(i+1, [&](auto &c){c.flush(m, m.count);});
+            }
+        }
+
+        ///Requests all threads to return their caches to the global cache
+        /** Cache of the current thread is returned now, other threads return their
+         * caches during their next allocation or deallocation
+         */
+        void requestFlush() {
+            flushEpoch.fetch_add(1, std::memory_order_relaxed);
+            ThreadCache *tc = ThreadCache::get();
+            if (tc) checkFlush(*tc);
+        }
+
+        ///Returns the thread cache to the global cache, if it was requested
+        void checkFlush(ThreadCache &tc) {
+            unsigned int e = flushEpoch.load(std::memory_order_relaxed);
+            if (tc.epoch != e) {
+                tc.epoch = e;
+                flush(tc);
+            }
+        }
+
         ///free extra memory
-        /** Method itself is not MT safe, it is MT safe relative to alloc/dealloc */
+        /** Method itself is not MT safe, it is MT safe relative to alloc/dealloc
+         *
+         * @note caches of other threads are returned during their next allocation or
+         * deallocation, so they are released by a next call
+         */
         void gc() {
+            requestFlush();
             //Garbage collector, shuts down the cache, to prevent allocation from cache during releasing
             //the cached memory
             shutdown();
             //when memory is released, restart the caches
-            for (int i = 0; i < 16; i++) {
+            for (int i = 0; i < levels; i++) {
                 chooseChain(i+1, [&](auto &c){c.restart();});
             }
         }
 
+        ///Release half of cached blocks of every size class
+        void trim() {
+            for (int i = 0; i < levels; i++) {
+                chooseChain(i+1, [&](auto &c){c.trim();});
+            }
+        }
+
         ///Alloate memory - method is MT safe (lockfree)
         void *alloc(std::size_t size) {
             if (size == 0) size = 1;
             int level = sizeToLevel(size);
             void *out;
+            ThreadCache *tc = ThreadCache::get();
+            if (tc) checkFlush(*tc);
             if (!chooseChain(level, [&](auto &block){
-                out = block.alloc();
+                out = tc?block.alloc(tc->mags[level-1]):block.alloc();
             })) {
                 out = ::operator new(size);
             }
@@ -224,8 +641,11 @@ class FastSharedAlloc {
         void free(void *ptr, std::size_t size) {
             if (size == 0) size = 1;
             int level = sizeToLevel(size);
+            ThreadCache *tc = ThreadCache::get();
+            if (tc) checkFlush(*tc);
             if (!chooseChain(level, [&](auto &block){
-                block.free(ptr);
+                if (tc) block.free(ptr, tc->mags[level-1]);
+                else block.free(ptr);
             })) {
                 ::operator delete(ptr);
             }
@@ -238,10 +658,59 @@ class FastSharedAlloc {
     }
 public:
 
+    ///count of size classes
+    static constexpr int size_classes = levels;
+
     static void gc() {
         return get_instance().gc();
     }
 
+    ///Releases half of cached blocks of every size class
+    /**
+     * Function is MT safe, it can run along with allocations. It is intended to be called
+     * periodically. Every thread is requested to return its cache to the global cache. The
+     * current thread does it immediately, other threads during their next allocation or
+     * deallocation, so their blocks are trimmed by the next call
+     */
+    static void trim() {
+        Allocator &a = get_instance();
+        a.requestFlush();
+        a.trim();
+    }
+
+    ///Retrieve statistics of a size class
+    /**
+     * @param size_class index of the size class (0 - size_classes-1)
+     * @return statistics
+     */
+    static ClassStats getStats(int size_class) {
+        ClassStats st = {};
+        get_instance().chooseChain(size_class+1, [&](auto &c){st = c.get_stats();});
+        return st;
+    }
+
+    ///Sets limit of cached blocks of a size class
+    /**
+     * @param size_class index of the size class (0 - size_classes-1)
+     * @param blocks maximum count of blocks in the global cache. Blocks above this limit
+     * are released immediately
+     */
+    static void setCacheLimit(int size_class, std::size_t blocks) {
+        get_instance().chooseChain(size_class+1, [&](auto &c){c.set_limit(blocks);});
+    }
+
+    ///Sets limit of cached memory for every size class
+    /**
+     * @param bytes maximum bytes cached in the global cache of every size class
+     */
+    static void setCacheLimit(std::size_t bytes) {
+        for (int i = 0; i < levels; i++) {
+            get_instance().chooseChain(i+1, [&](auto &c){
+                c.set_limit(bytes/std::decay_t<decltype(c)>::Blk::blk_size);
+            });
+        }
+    }
+
     void *operator new(std::size_t sz) {
         return get_instance().alloc(sz);
     }
@@ -251,6 +720,22 @@ public:
     }
 };
 
+inline FastSharedAlloc::ThreadCache::ThreadCache() {
+    //ensure, that allocator is constructed before the cache, so it is destroyed after
+    epoch = get_instance().flushEpoch.load(std::memory_order_relaxed);
+    state() = alive;
+}
+
+inline FastSharedAlloc::ThreadCache::~ThreadCache() {
+    state() = destroyed;
+    get_instance().flush(*this);
+}
+
+template<typename X>
+constexpr FastSharedAlloc::BlockBase FastSharedAlloc::BlockBase2T<X>::dummy_shutdown;
+template<typename X>
+constexpr FastSharedAlloc::BlockBase FastSharedAlloc::BlockBase2T<X>::dummy_busy;
+
 
 
 }
@@ -0,0 +1,306 @@
+/** @file Some function to fast convert strings to numbers (not using locales) */
+
+#ifndef _ONDRA_SHARED_FROMSTRING_H_28390128309182_
+#define _ONDRA_SHARED_FROMSTRING_H_28390128309182_
+
+#include <cctype>
+#include <cerrno>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#if defined(__cpp_lib_to_chars)
+#define ONDRA_SHARED_FROMSTRING_HAS_FROM_CHARS 1
+#endif
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) \
+     || defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64)
+#define ONDRA_SHARED_FROMSTRING_SWAR 1
+#endif
+
+namespace ondra_shared {
+
+///Result of the conversion
+/**
+ * Same meaning as std::from_chars_result
+ *
+ * @li ptr - pointer to first character which was not parsed
+ * @li ec - std::errc() if successful, std::errc::invalid_argument if there is no number,
+ * std::errc::result_out_of_range if the number doesn't fit to the result. In case of
+ * error, the result is not modified.
+ */
+struct FromStringResult {
+     const char *ptr;
+     std::errc ec;
+
+     explicit operator bool() const {return ec == std::errc();}
+};
+
+namespace _details {
+
+     ///Tests whether 8 characters loaded to the number are all digits
+     inline bool isEightDigits(std::uint64_t v) {
+          return (((v & 0xF0F0F0F0F0F0F0F0ULL)
+                    | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+                    == 0x3333333333333333ULL);
+     }
+
+     ///Converts 8 digits loaded to the number (little endian) in one step
+     inline std::uint32_t parseEightDigits(std::uint64_t v) {
+          v -= 0x3030303030303030ULL;
+          v = (v * 10) + (v >> 8);
+          v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+                    + (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+          return static_cast<std::uint32_t>(v);
+     }
+
+     inline unsigned int digitValue(char c) {
+          if (c >= '0' && c <= '9') return c - '0';
+          if (c >= 'a' && c <= 'z') return c - 'a' + 10;
+          if (c >= 'A' && c <= 'Z') return c - 'A' + 10;
+          return 255;
+     }
+
+     ///Parses digits
+     /**
+      * @param beg begin of the text
+      * @param end end of the text
+      * @param base base
+      * @param out parsed value
+      * @param overflow set to true if the value doesn't fit to the unsigned long long.
+      * All digits are consumed anyway
+      * @return pointer after last digit
+      */
+     inline const char *parseDigits(const char *beg, const char *end, unsigned int base,
+                                   unsigned long long &out, bool &overflow) {
+          constexpr unsigned long long maxv = std::numeric_limits<unsigned long long>::max();
+          unsigned long long v = 0;
+          const char *p = beg;
+          overflow = false;
+          if (base == 10) {
+#ifdef ONDRA_SHARED_FROMSTRING_SWAR
+               //first 16 digits can't overflow, parse them by 8
+               while (end - p >= 8 && p - beg <= 8) {
+                    std::uint64_t chunk;
+                    std::memcpy(&chunk, p, 8);
+                    if (!isEightDigits(chunk)) break;
+                    v = v * 100000000ULL + parseEightDigits(chunk);
+                    p += 8;
+               }
+#endif
+               while (p != end) {
+                    unsigned int d = static_cast<unsigned int>(static_cast<unsigned char>(*p)) - '0';
+                    if (d > 9) break;
+                    if (v > (maxv - d) / 10) overflow = true;
+                    else v = v * 10 + d;
+                    ++p;
+               }
+          } else {
+               while (p != end) {
+                    unsigned int d = digitValue(*p);
+                    if (d >= base) break;
+                    if (v > (maxv - d) / base) overflow = true;
+                    else v = v * base + d;
+                    ++p;
+               }
+          }
+          out = v;
+          return p;
+     }
+
+     template<typename Number> struct FloatTraits;
+     template<> struct FloatTraits<double> {
+          static constexpr unsigned long long max_exact_mantissa = 1ULL<<53;
+          static constexpr int max_exact_exp = 22;
+          static double pow10(int e) {
+               static const double table[] = {
+                    1e0,1e1,1e2,1e3,1e4,1e5,1e6,1e7,1e8,1e9,1e10,1e11,
+                    1e12,1e13,1e14,1e15,1e16,1e17,1e18,1e19,1e20,1e21,1e22
+               };
+               return table[e];
+          }
+          static double strto(const char *str, char **e) {return std::strtod(str, e);}
+     };
+     template<> struct FloatTraits<float> {
+          static constexpr unsigned long long max_exact_mantissa = 1ULL<<24;
+          static constexpr int max_exact_exp = 10;
+          static float pow10(int e) {
+               static const float table[] = {
+                    1e0f,1e1f,1e2f,1e3f,1e4f,1e5f,1e6f,1e7f,1e8f,1e9f,1e10f
+               };
+               return table[e];
+          }
+          static float strto(const char *str, char **e) {return std::strtof(str, e);}
+     };
+
+     ///Slow path of the float conversion
+     template<typename Number>
+     FromStringResult parseFloatSlow(const char *beg, const char *end, Number &value) {
+#ifdef ONDRA_SHARED_FROMSTRING_HAS_FROM_CHARS
+          auto r = std::from_chars(beg, end, value);
+          return FromStringResult{r.ptr, r.ec};
+#else
+          //strtod skips whitespaces and accepts '+', which is not allowed here
+          if (beg == end || *beg == '+' || std::isspace(static_cast<unsigned char>(*beg))) {
+               return FromStringResult{beg, std::errc::invalid_argument};
+          }
+          //strtod requires terminating zero
+          std::string tmp(beg, end);
+          char *e;
+          errno = 0;
+          Number v = FloatTraits<Number>::strto(tmp.c_str(), &e);
+          const char *ptr = beg + (e - tmp.c_str());
+          if (ptr == beg) return FromStringResult{beg, std::errc::invalid_argument};
+          //strtod reports ERANGE for denormals too, these are valid
+          if (errno == ERANGE && (v == 0 || std::isinf(v))) {
+               return FromStringResult{ptr, std::errc::result_out_of_range};
+          }
+          value = v;
+          return FromStringResult{ptr, std::errc()};
+#endif
+     }
+
+}
+
+///Parses unsigned number
+/**
+ * @param beg begin of the text
+ * @param end end of the text
+ * @param value variable which receives the value
+ * @param base base (2-36). Prefixes (0x) are not recognized
+ * @return result of the conversion
+ *
+ * @note decimal numbers are parsed by 8 digits at once
+ */
+template<typename Number>
+FromStringResult unsignedFromString(const char *beg, const char *end, Number &value, int base = 10) {
+     unsigned long long v;
+     bool overflow;
+     const char *p = _details::parseDigits(beg, end, base, v, overflow);
+     if (p == beg) return FromStringResult{beg, std::errc::invalid_argument};
+     if (overflow || v > static_cast<unsigned long long>(std::numeric_limits<Number>::max())) {
+          return FromStringResult{p, std::errc::result_out_of_range};
+     }
+     value = static_cast<Number>(v);
+     return FromStringResult{p, std::errc()};
+}
+
+///Parses signed number
+/**
+ * @copydetails unsignedFromString
+ *
+ * @note number can start with '-'. The '+' is not allowed
+ */
+template<typename Number>
+FromStringResult signedFromString(const char *beg, const char *end, Number &value, int base = 10) {
+     bool neg = beg != end && *beg == '-';
+     unsigned long long v;
+     bool overflow;
+     const char *b = beg + (neg?1:0);
+     const char *p = _details::parseDigits(b, end, base, v, overflow);
+     if (p == b) return FromStringResult{beg, std::errc::invalid_argument};
+     unsigned long long limit = static_cast<unsigned long long>(std::numeric_limits<Number>::max());
+     if (overflow || v > limit + (neg?1:0)) {
+          return FromStringResult{p, std::errc::result_out_of_range};
+     }
+     if (neg) {
+          value = v?static_cast<Number>(-static_cast<Number>(v - 1) - 1):Number(0);
+     } else {
+          value = static_cast<Number>(v);
+     }
+     return FromStringResult{p, std::errc()};
+}
+
+///Parses floating number
+/**
+ * Accepts the same format as std::from_chars (general format): optional '-', digits with
+ * optional decimal point and optional exponent. It also accepts "inf" and "nan".
+ *
+ * Numbers with at most 19 significant digits, which can be represented exactly are
+ * converted directly. Others are converted by std::from_chars (if available, otherwise
+ * by strtod). The result is always correctly rounded.
+ *
+ * @param beg begin of the text
+ * @param end end of the text
+ * @param value variable which receives the value (float or double)
+ * @return result of the conversion
+ */
+template<typename Number>
+FromStringResult floatFromString(const char *beg, const char *end, Number &value) {
+     using Traits = _details::FloatTraits<Number>;
+     const char *p = beg;
+     bool neg = p != end && *p == '-';
+     if (neg) ++p;
+     unsigned long long m = 0;
+     int sig = 0;
+     int exp10 = 0;
+     bool digits = false;
+     bool frac = false;
+     bool slow = false;
+     while (p != end) {
+          char c = *p;
+          if (c >= '0' && c <= '9') {
+               if (sig < 19) {
+                    m = m * 10 + (c - '0');
+                    if (m) ++sig;
+                    if (frac) --exp10;
+               } else {
+                    slow = true;
+               }
+               digits = true;
+          } else if (c == '.' && !frac) {
+               frac = true;
+          } else {
+               break;
+          }
+          ++p;
+     }
+     if (!digits) return _details::parseFloatSlow(beg, end, value);
+     if (p != end && (*p == 'e' || *p == 'E')) {
+          const char *q = p+1;
+          bool eneg = q != end && *q == '-';
+          if (q != end && (*q == '-' || *q == '+')) ++q;
+          unsigned long long e;
+          bool overflow;
+          const char *r = _details::parseDigits(q, end, 10, e, overflow);
+          if (r != q) {
+               if (overflow || e > 100000) slow = true;
+               else exp10 += eneg?-static_cast<int>(e):static_cast<int>(e);
+               p = r;
+          }
+     }
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+     if (!slow && m == 0) {
+          value = neg?-Number(0):Number(0);
+          return FromStringResult{p, std::errc()};
+     }
+     if (!slow && m <= Traits::max_exact_mantissa
+               && exp10 >= -Traits::max_exact_exp && exp10 <= Traits::max_exact_exp) {
+          //both mantissa and power of ten are exact, so the result is correctly rounded
+          Number v = static_cast<Number>(m);
+          if (exp10 < 0) v /= Traits::pow10(-exp10);
+          else v *= Traits::pow10(exp10);
+          value = neg?-v:v;
+          return FromStringResult{p, std::errc()};
+     }
+#endif
+     return _details::parseFloatSlow(beg, end, value);
+}
+
+
+}
+
+
+#endif
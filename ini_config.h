@@ -7,12 +7,16 @@
 
 #ifndef _ONDRA_SHARED_INI_CONFIG_23123148209810_
 #define _ONDRA_SHARED_INI_CONFIG_23123148209810_
+#include <cstdlib>
+#include <limits>
 #include <map>
+#include <stdexcept>
 #include <string>
 #include <fstream>
 
 
 
+#include "fromString.h"
 #include "ini_parser.h"
 #include "stringpool.h"
 #include "virtualMember.h"
@@ -54,6 +58,8 @@ public:
 
           template<typename T>
           static void checkSuffix(char c, T &v);
+          ///Creates exception reported when number doesn't fit to the result
+          std::out_of_range outOfRange() const;
 
           static const Value &undefined() {
                static Value udef(String(std::string_view("undef",0)), String());
@@ -348,16 +354,22 @@ inline void IniConfig::Value::checkSuffix(char c, T &v) {
 
 inline std::size_t IniConfig::Value::getUInt() const {
      std::size_t x = 0;
-     for (char c : v.getView()) {
-          if (isdigit(c)) x = x * 10 + (c - '0');
-          else {
-               checkSuffix(c, x);
-               break;
-          }
+     auto sv = v.getView();
+     auto r = unsignedFromString(sv.data(), sv.data()+sv.size(), x);
+     if (r.ec == std::errc::result_out_of_range) throw outOfRange();
+     if (r.ptr != sv.data()+sv.size()) {
+          std::size_t mult = 1;
+          checkSuffix(*r.ptr, mult);
+          if (x > std::numeric_limits<std::size_t>::max() / mult) throw outOfRange();
+          x *= mult;
      }
      return x;
 }
 
+inline std::out_of_range IniConfig::Value::outOfRange() const {
+     return std::out_of_range(std::string("Value is out of range: ").append(getString()));
+}
+
 inline bool IniConfig::Value::getBool() const {
 
      constexpr auto cmpstr = [](std::string_view a, std::string_view b) {
@@ -384,9 +396,13 @@ inline std::intptr_t IniConfig::Value::getInt() const {
      if (sv[0] == '-') {
           Value z;
           z.v = sv.substr(1);
-          return - (std::intptr_t) z.getUInt();
+          std::size_t x = z.getUInt();
+          if (x > static_cast<std::size_t>(std::numeric_limits<std::intptr_t>::max()) + 1) throw outOfRange();
+          return x?-static_cast<std::intptr_t>(x - 1) - 1:0;
      } else {
-          return (std::intptr_t)getUInt();
+          std::size_t x = getUInt();
+          if (x > static_cast<std::size_t>(std::numeric_limits<std::intptr_t>::max())) throw outOfRange();
+          return static_cast<std::intptr_t>(x);
      }
 }
 
@@ -451,9 +467,17 @@ inline std::string_view IniConfig::Value::getString(const std::string_view& defa
 }
 
 inline double IniConfig::Value::getNumber() const {
-     char *c;
-     double d = strtod(c_str(),&c);
-     if (c) checkSuffix(*c,d);
+     double d = 0;
+     auto sv = v.getView();
+     const char *end = sv.data()+sv.size();
+     auto r = floatFromString(sv.data(), end, d);
+     if (r.ec != std::errc() || (r.ptr != end && (*r.ptr == 'x' || *r.ptr == 'X'))) {
+          //leading '+', hexadecimal numbers and whitespaces are accepted by strtod only
+          char *c;
+          d = std::strtod(c_str(), &c);
+          r.ptr = c;
+     }
+     if (r.ptr != end) checkSuffix(*r.ptr,d);
      return d;
 }
 
@@ -1,8 +1,15 @@
 #ifndef _ONDRA_SHARED_DEBUGLOG_H_2908332900212092_
 #define _ONDRA_SHARED_DEBUGLOG_H_2908332900212092_
 #include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <atomic>
+#include <string>
+#include <tuple>
+#include <utility>
 
 #include "stringview.h"
 #include "toString.h"
@@ -103,6 +110,22 @@ public:
       */
      virtual void commit(const MutableStrViewA &text) = 0;
 
+     ///Starts a log message in the binary capture mode
+     /**
+      * The caller doesn't format the message. It writes a pointer to the pattern and
+      * binary copy of the arguments to the buffer. The provider formats the message
+      * later by the function logFormatCaptured(), usually in a background thread.
+      *
+      * @param level log level
+      * @param size size of captured data in bytes
+      * @return pointer to the buffer for the captured data. The function
+      * returns nullptr, if the provider doesn't support this mode. Then
+      * the caller must format the message in the standard way
+      */
+     virtual char *startCapture(LogLevel , std::size_t ) {return nullptr;}
+     ///Commits the captured message
+     virtual void commitCapture() {}
+
 
      ///Creates copy of current log provider for specified part of the code which doesn't execute in the single thread
      /** You attach the log provider to an object and call the log provider
@@ -188,6 +211,74 @@ public:
      }
 };
 
+///Cache of the log level enabled for the current thread
+/**
+ * Every thread keeps a copy of the lowest level enabled by its log provider. The copy is
+ * refreshed when the global epoch changes (see invalidate()) or when the provider of the
+ * thread is replaced. Test of the disabled level doesn't call any virtual function.
+ *
+ * Provider, whose level can be changed at runtime, must call invalidate() after the
+ * change. StdLogProviderFactory::setEnabledLogLevel() does it.
+ */
+class LogLevelCache {
+public:
+
+     ///Returns true, if the level is enabled for the log provider of the current thread
+     static bool isEnabled(LogLevel level) {
+          const Local &l = local();
+          if (l.epoch != epoch().load(std::memory_order_relaxed)
+                    || l.provider == nullptr
+                    || l.provider != AbstractLogProvider::getInstance().get()) return refresh(level);
+          return level >= l.level;
+     }
+
+     ///Invalidates copies of the level in all threads
+     static void invalidate() {
+          epoch().fetch_add(1, std::memory_order_release);
+     }
+
+     ///Returns current epoch. The cached level is valid while the epoch is the same
+     static unsigned int getEpoch() {
+          return epoch().load(std::memory_order_acquire);
+     }
+
+     ///Finds the lowest level enabled by the object (provider or factory)
+     template<typename T>
+     static LogLevel lowestLevel(const T *obj) {
+          if (obj == nullptr) return LogLevel::off;
+          for (int i = static_cast<int>(LogLevel::debug); i < static_cast<int>(LogLevel::off); i++) {
+               if (obj->isLogLevelEnabled(static_cast<LogLevel>(i))) return static_cast<LogLevel>(i);
+          }
+          return LogLevel::off;
+     }
+
+protected:
+
+     struct Local {
+          unsigned int epoch;
+          LogLevel level;
+          const AbstractLogProvider *provider;
+     };
+
+     static Local &local() {
+          static thread_local Local l = {0, LogLevel::off, nullptr};
+          return l;
+     }
+
+     static std::atomic<unsigned int> &epoch() {
+          static std::atomic<unsigned int> e(1);
+          return e;
+     }
+
+     static bool refresh(LogLevel level) {
+          Local &l = local();
+          l.epoch = getEpoch();
+          l.provider = AbstractLogProvider::initInstance().get();
+          l.level = lowestLevel(l.provider);
+          return level >= l.level;
+     }
+};
+
 
 
 
@@ -236,6 +327,202 @@ protected:
      char dummybuff[32];
 };
 
+///Rate limiting and sampling of log messages
+/**
+ * Rate limit is applied per call site, the site is identified by the address of the
+ * pattern. It is applied only to patterns declared by LOG_PATTERN. Messages with
+ * other patterns (string literals, std::string, StrViewA) are not limited, because
+ * a char array can be a temporary buffer, while the site keeps the pointer to the pattern.
+ * Every site has a token bucket, which allows a burst of messages and then given count
+ * of messages per second. Messages above the limit are dropped and counted. Next message
+ * of the site, which passes the limit, is preceded by the summary "Suppressed N messages: <pattern>".
+ * Summaries of sites, which are still suppressed, are logged every second along with
+ * any message, which passes the limit.
+ *
+ * Sampling randomly passes only a fraction of debug messages. These messages are
+ * not counted.
+ *
+ * Both features are disabled by default. When they are disabled, the check is a single
+ * relaxed load. When they are enabled, a message which passes costs an extra
+ * lookup in the table of sites and one atomic compare-exchange
+ */
+class LogRateLimit {
+public:
+
+     ///Sets the limit
+     /**
+      * @param perSecond count of messages per second per call site. Set 0 to disable the limit
+      * @param burst count of messages, which can be logged at once before the limit is applied
+      */
+     static void setLimit(unsigned int perSecond, unsigned int burst = 10) {
+          State &st = state();
+          st.interval.store(perSecond?1000000000LL/perSecond:0, std::memory_order_relaxed);
+          st.burst.store(std::max(burst,1U), std::memory_order_relaxed);
+          updateActive();
+     }
+
+     ///Sets sampling of debug messages
+     /**
+      * @param probability probability, that a debug message is logged (0.0 - 1.0). Set 1.0
+      * to log all debug messages
+      */
+     static void setDebugSampling(double probability) {
+          State &st = state();
+          std::uint32_t threshold = probability >= 1.0?0xFFFFFFFFU
+                    :probability <= 0.0?0:static_cast<std::uint32_t>(probability * 4294967296.0);
+          st.sampling.store(threshold, std::memory_order_relaxed);
+          updateActive();
+     }
+
+     ///Returns true, if the limit or sampling is enabled
+     static bool isActive() {
+          return state().active.load(std::memory_order_relaxed);
+     }
+
+     ///Decides whether the message can be logged
+     /**
+      * @param site identification of the call site (address of the pattern). It must
+      * point to the static pattern, which is used by the summary. Set nullptr if the
+      * pattern is not declared by LOG_PATTERN, the limit is not applied then
+      * @param length length of the pattern (used by the summary)
+      * @param level level of the message
+      * @param suppressed receives count of messages suppressed since the last passed message
+      * @return true to log the message, false to drop it
+      */
+     static bool admit(const void *site, std::size_t length, LogLevel level, std::size_t &suppressed) {
+          State &st = state();
+          suppressed = 0;
+          if (level == LogLevel::debug) {
+               std::uint32_t threshold = st.sampling.load(std::memory_order_relaxed);
+               if (threshold != 0xFFFFFFFFU && random() >= threshold) return false;
+          }
+          std::int64_t interval = st.interval.load(std::memory_order_relaxed);
+          if (interval == 0 || site == nullptr) return true;
+          Slot *slot = findSlot(st, site, length);
+          if (slot == nullptr) return true;
+          //token bucket implemented as "theoretical arrival time" - one atomic variable
+          std::int64_t now = monotonicTime();
+          std::int64_t limit = now + interval * st.burst.load(std::memory_order_relaxed);
+          std::int64_t tat = slot->tat.load(std::memory_order_relaxed);
+          std::int64_t next;
+          do {
+               next = std::max(tat, now) + interval;
+               if (next > limit) {
+                    slot->level.store(level, std::memory_order_relaxed);
+                    slot->suppressed.fetch_add(1, std::memory_order_relaxed);
+                    if (!st.pending.load(std::memory_order_relaxed)) st.pending.store(true, std::memory_order_relaxed);
+                    return false;
+               }
+          } while (!slot->tat.compare_exchange_weak(tat, next, std::memory_order_relaxed));
+          if (slot->suppressed.load(std::memory_order_relaxed)) {
+               suppressed = slot->suppressed.exchange(0, std::memory_order_relaxed);
+          }
+          return true;
+     }
+
+     ///Reports messages suppressed by all sites, at most once per second
+     /**
+      * @param fn function which receives level, count of suppressed messages and the pattern
+      * (LogLevel, std::size_t, StrViewA). It is called for every site, which suppressed
+      * a message since the last report.
+      */
+     template<typename Fn>
+     static void reportSuppressed(Fn &&fn) {
+          State &st = state();
+          if (!st.pending.load(std::memory_order_relaxed)) return;
+          std::int64_t now = monotonicTime();
+          std::int64_t nx = st.nextReport.load(std::memory_order_relaxed);
+          if (now < nx || !st.nextReport.compare_exchange_strong(nx, now + reportInterval,
+                    std::memory_order_relaxed)) return;
+          st.pending.store(false, std::memory_order_relaxed);
+          for (Slot &s: st.slots) {
+               //length is stored after the slot is allocated, skip the slot until it is known
+               std::size_t length = s.length.load(std::memory_order_acquire);
+               if (length && s.suppressed.load(std::memory_order_relaxed)) {
+                    std::size_t cnt = s.suppressed.exchange(0, std::memory_order_relaxed);
+                    const char *site = static_cast<const char *>(s.site.load(std::memory_order_relaxed));
+                    if (cnt) fn(s.level.load(std::memory_order_relaxed), cnt, StrViewA(site, length));
+               }
+          }
+     }
+
+protected:
+
+     static constexpr std::size_t tableSize = 1024;
+     static constexpr std::size_t maxProbe = 8;
+     ///interval of reports of suppressed messages in nanoseconds
+     static constexpr std::int64_t reportInterval = 1000000000LL;
+
+     struct Slot {
+          std::atomic<const void *> site;
+          std::atomic<std::size_t> length;
+          std::atomic<std::int64_t> tat;
+          std::atomic<std::size_t> suppressed;
+          std::atomic<LogLevel> level;
+     };
+
+     struct State {
+          std::atomic<bool> active;
+          std::atomic<std::int64_t> interval;
+          std::atomic<unsigned int> burst;
+          std::atomic<std::uint32_t> sampling;
+          ///some site suppressed messages since the last report
+          std::atomic<bool> pending;
+          ///time of the next report
+          std::atomic<std::int64_t> nextReport;
+          Slot slots[tableSize];
+     };
+
+     static State &state() {
+          static State st = {{false},{0},{10},{0xFFFFFFFFU},{false},{0},{}};
+          return st;
+     }
+
+     static void updateActive() {
+          State &st = state();
+          st.active.store(st.interval.load(std::memory_order_relaxed) != 0
+                    || st.sampling.load(std::memory_order_relaxed) != 0xFFFFFFFFU,
+                    std::memory_order_relaxed);
+     }
+
+     ///Finds or allocates the slot of the site. Returns nullptr if the table is full
+     /** Slots are never released, because sites are static patterns, so their count is limited */
+     static Slot *findSlot(State &st, const void *site, std::size_t length) {
+          std::size_t h = (reinterpret_cast<std::uintptr_t>(site) * 0x9E3779B97F4A7C15ULL) >> 40;
+          for (std::size_t i = 0; i < maxProbe; i++) {
+               Slot &s = st.slots[(h + i) % tableSize];
+               const void *cur = s.site.load(std::memory_order_relaxed);
+               if (cur == site) return &s;
+               if (cur == nullptr && s.site.compare_exchange_strong(cur, site, std::memory_order_relaxed)) {
+                    s.length.store(length, std::memory_order_release);
+                    return &s;
+               }
+               if (cur == site) return &s;
+          }
+          return nullptr;
+     }
+
+     static std::int64_t monotonicTime() {
+#ifdef CLOCK_MONOTONIC_COARSE
+          timespec ts;
+          clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+          return static_cast<std::int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+#else
+          return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+     }
+
+     ///Per thread pseudo-random generator (xorshift)
+     static std::uint32_t random() {
+          static thread_local std::uint64_t x = reinterpret_cast<std::uintptr_t>(&x) | 1;
+          x ^= x << 13;
+          x ^= x >> 7;
+          x ^= x << 17;
+          return static_cast<std::uint32_t>(x >> 32);
+     }
+};
+
 
 template<typename WriteFn> void logPrintValue(WriteFn &wr, StrViewA v) {     wr(v);}
 template<typename WriteFn> void logPrintValue(WriteFn &wr, const char *v) {     wr(StrViewA(v));}
@@ -243,16 +530,31 @@ template<typename WriteFn> void logPrintValue(WriteFn &wr, char *v) {     wr(Str
 template<typename WriteFn> void logPrintValue(WriteFn &wr, BinaryView v) {
      for (auto &&c : v) unsignedToString(c,wr,16,2);
 }
-template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned long long v) {unsignedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned long v) {unsignedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned int v) {unsignedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned short v) {unsignedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, signed long long v) {signedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, signed long v) {signedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, signed int v) {signedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, signed short v) {signedToString(v,wr);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, double v) {floatToString(v,wr,8);}
-template<typename WriteFn> void logPrintValue(WriteFn &wr, float v) {floatToString(v,wr,8);}
+namespace _logDetails {
+     template<typename WriteFn, typename T> void printUnsigned(WriteFn &wr, T v) {
+          char buff[numberBufferSize<T>()];
+          wr(StrViewA(buff, unsignedToBuffer(v, buff) - buff));
+     }
+     template<typename WriteFn, typename T> void printSigned(WriteFn &wr, T v) {
+          char buff[numberBufferSize<T>()];
+          wr(StrViewA(buff, signedToBuffer(v, buff) - buff));
+     }
+     template<typename WriteFn, typename T> void printFloat(WriteFn &wr, T v) {
+          char buff[floatBufferSize];
+          wr(StrViewA(buff, floatToBuffer(v, buff) - buff));
+     }
+}
+
+template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned long long v) {_logDetails::printUnsigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned long v) {_logDetails::printUnsigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned int v) {_logDetails::printUnsigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, unsigned short v) {_logDetails::printUnsigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, signed long long v) {_logDetails::printSigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, signed long v) {_logDetails::printSigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, signed int v) {_logDetails::printSigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, signed short v) {_logDetails::printSigned(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, double v) {_logDetails::printFloat(wr,v);}
+template<typename WriteFn> void logPrintValue(WriteFn &wr, float v) {_logDetails::printFloat(wr,v);}
 template<typename WriteFn, typename T> void logPrintValue(WriteFn &wr, const std::initializer_list<T> &v) {
      for (auto &&x:v ) {
           wr(" ");
@@ -266,10 +568,11 @@ template<typename WriteFn, typename T> void logPrintValue(const WriteFn &wr, T *
 
 namespace _logDetails {
 
-     static inline void renderNthArg(LogWriterFn &, unsigned int ) {}
+     template<typename WriteFn>
+     inline void renderNthArg(WriteFn &, unsigned int ) {}
 
-     template<typename T, typename... Args>
-     static inline void renderNthArg(LogWriterFn &wr, unsigned int index, T &&arg1, Args &&... args) {
+     template<typename WriteFn, typename T, typename... Args>
+     inline void renderNthArg(WriteFn &wr, unsigned int index, T &&arg1, Args &&... args) {
           if (index == 1) {
                logPrintValue(wr, std::forward<T>(arg1));
           } else {
@@ -278,76 +581,507 @@ namespace _logDetails {
      }
 }
 
-
-template<typename Provider, typename... Args>
-void logPrint(Provider &lp, LogLevel level, const StrViewA &pattern, Args&&... args) {
+///Formats the pattern with arguments
+/**
+ * @param wr function which receives characters and strings
+ * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+ * @param args arguments for placeholders
+ */
+template<typename WriteFn, typename... Args>
+void logFormat(WriteFn &wr, const StrViewA &pattern, Args&&... args) {
 
      using namespace _logDetails;
 
-     if (lp == nullptr) return;
-
-     AbstractLogProvider *p = lp.get();
-     LogWriterFn wr(p,level);
-     if (wr.enabled) {
-
-          enum CurMode {
-               readChar,
-               readStartArg,
-               readArgIndex,
-               readParIndex
-          };
+     enum CurMode {
+          readChar,
+          readStartArg,
+          readArgIndex,
+          readParIndex
+     };
 
-          CurMode md = readChar;
-          unsigned int curIndex = 0;
-          for (auto c : pattern) {
-               switch (md) {
-               case readChar:
-                    if (c == '$') md = readStartArg;
-                    else wr(c);
-                    break;
-               case readStartArg:
-                    if (isdigit(c)) {
-                         curIndex = c - '0';
-                         md = readArgIndex;
-                    } else if (c == '(') {
-                         md = readParIndex;
-                    } else {
-                         wr(c);
-                         md = readChar;
-                    }
-                    break;
-               case readArgIndex:
-                    if (isdigit(c)) {
-                         curIndex = curIndex * 10 + (c - '0');
+     CurMode md = readChar;
+     unsigned int curIndex = 0;
+     for (auto c : pattern) {
+          switch (md) {
+          case readChar:
+               if (c == '$') md = readStartArg;
+               else wr(c);
+               break;
+          case readStartArg:
+               if (isdigit(c)) {
+                    curIndex = c - '0';
+                    md = readArgIndex;
+               } else if (c == '(') {
+                    curIndex = 0;
+                    md = readParIndex;
+               } else {
+                    wr(c);
+                    md = readChar;
+               }
+               break;
+          case readArgIndex:
+               if (isdigit(c)) {
+                    curIndex = curIndex * 10 + (c - '0');
+               } else {
+                    renderNthArg(wr, curIndex, std::forward<Args>(args)...);
+                    if (c == '$') {
+                         md = readStartArg;
                     } else {
-                         renderNthArg(wr, curIndex, std::forward<Args>(args)...);
                          md = readChar;
                          wr(c);
                     }
-                    break;
-               case readParIndex:
-                    if (isdigit(c)) {
-                         curIndex = curIndex * 10 + (c - '0');
-                    } else if (c == ')') {
-                         renderNthArg(wr, curIndex, std::forward<Args>(args)...);
-                         md = readChar;
-                    } else {
-                         wr("$(");
-                         unsignedToString(curIndex, wr,10,1);
-                         md = readChar;
-                         wr(c);
+               }
+               break;
+          case readParIndex:
+               if (isdigit(c)) {
+                    curIndex = curIndex * 10 + (c - '0');
+               } else if (c == ')') {
+                    renderNthArg(wr, curIndex, std::forward<Args>(args)...);
+                    md = readChar;
+               } else {
+                    wr("$(");
+                    unsignedToString(curIndex, wr,10,1);
+                    md = readChar;
+                    wr(c);
+               }
+               break;
+          }
+     }
+     if (md == readArgIndex) {
+          renderNthArg(wr, curIndex, std::forward<Args>(args)...);
+     }
+}
+
+///Base class of patterns parsed at compile time - see LOG_PATTERN
+struct LogStaticPattern {};
+
+///Declares log pattern, which is parsed at compile time
+/**
+ * @param str string literal
+ *
+ * The pattern is split to literal spans and placeholders during compilation, so the
+ * log call is a straight sequence of writes. Placeholder which refers non-existing
+ * argument, or malformed placeholder causes compile error
+ *
+ * @code
+ * logInfo(LOG_PATTERN("Connected to $1:$2"), host, port);
+ * @endcode
+ */
+#define LOG_PATTERN(str) ([]{ \
+     struct LogPattern_: ::ondra_shared::LogStaticPattern { \
+          static constexpr const char *get() {return str;} \
+          static constexpr std::size_t size() {return sizeof(str)-1;} \
+     }; \
+     return LogPattern_(); \
+}())
+
+template<typename T>
+using IsLogStaticPattern = std::is_base_of<LogStaticPattern, T>;
+
+namespace _logDetails {
+
+     ///Part of the pattern - literal text or placeholder
+     struct PatternSegment {
+          ///position of the literal text
+          std::size_t pos = 0;
+          ///length of the literal text
+          std::size_t len = 0;
+          ///index of the argument (1-based), 0 for literal text
+          unsigned int arg = 0;
+          ///segment is placeholder
+          bool placeholder = false;
+          ///placeholder is malformed
+          bool error = false;
+     };
+
+     constexpr bool isPatternDigit(char c) {return c >= '0' && c <= '9';}
+
+     ///Reads segment at given position (same rules as logFormat)
+     /**
+      * @param s pattern
+      * @param n length of the pattern
+      * @param pos position, it is moved to the next segment
+      * @return segment
+      */
+     constexpr PatternSegment readPatternSegment(const char *s, std::size_t n, std::size_t &pos) {
+          PatternSegment seg;
+          if (s[pos] == '$') {
+               ++pos;
+               if (pos < n && (isPatternDigit(s[pos]) || s[pos] == '(')) {
+                    bool par = s[pos] == '(';
+                    if (par) ++pos;
+                    std::size_t beg = pos;
+                    while (pos < n && isPatternDigit(s[pos])) {
+                         seg.arg = seg.arg * 10 + (s[pos] - '0');
+                         ++pos;
+                    }
+                    seg.placeholder = true;
+                    if (par) {
+                         if (pos == beg || pos == n || s[pos] != ')') seg.error = true;
+                         else ++pos;
                     }
-                    break;
+                    return seg;
                }
+               //'$' followed by other character is removed
+          }
+          seg.pos = pos;
+          if (pos < n) ++pos;
+          while (pos < n && s[pos] != '$') ++pos;
+          seg.len = pos - seg.pos;
+          return seg;
+     }
+
+     constexpr std::size_t patternSegmentCount(const char *s, std::size_t n) {
+          std::size_t pos = 0;
+          std::size_t cnt = 0;
+          while (pos < n) {
+               readPatternSegment(s, n, pos);
+               ++cnt;
+          }
+          return cnt;
+     }
+
+     constexpr PatternSegment patternSegment(const char *s, std::size_t n, std::size_t index) {
+          std::size_t pos = 0;
+          PatternSegment seg = readPatternSegment(s, n, pos);
+          while (index--) seg = readPatternSegment(s, n, pos);
+          return seg;
+     }
+
+     template<unsigned int arg> struct RenderSegment {
+          template<typename WriteFn, typename Tuple>
+          static void render(WriteFn &wr, const char *, const PatternSegment &, Tuple &args) {
+               logPrintValue(wr, std::get<arg-1>(args));
           }
-          if (md == readArgIndex) {
-               renderNthArg(wr, curIndex, std::forward<Args>(args)...);
+     };
+
+     template<> struct RenderSegment<0> {
+          template<typename WriteFn, typename Tuple>
+          static void render(WriteFn &wr, const char *pattern, const PatternSegment &seg, Tuple &) {
+               if (seg.len) wr(StrViewA(pattern+seg.pos, seg.len));
           }
+     };
+
+     template<typename Pattern, std::size_t index, typename WriteFn, typename Tuple>
+     int renderSegment(WriteFn &wr, Tuple &args) {
+          constexpr PatternSegment seg = patternSegment(Pattern::get(), Pattern::size(), index);
+          constexpr bool valid = seg.arg >= 1 && seg.arg <= std::tuple_size<Tuple>::value;
+          static_assert(!seg.error, "Malformed placeholder $(n) in the log pattern");
+          static_assert(!seg.placeholder || valid, "Placeholder in the log pattern refers to non-existing argument");
+          RenderSegment<seg.placeholder && valid?seg.arg:0>::render(wr, Pattern::get(), seg, args);
+          return 0;
+     }
+
+     template<typename Pattern, typename WriteFn, typename Tuple, std::size_t... idx>
+     void renderSegments(WriteFn &wr, Tuple &args, std::index_sequence<idx...>) {
+          int dummy[] = {0, renderSegment<Pattern, idx>(wr, args)...};
+          (void)dummy;
      }
 
+     ///Pattern parsed at compile time is passed as is, other patterns are passed as string
+     template<typename T>
+     typename std::enable_if<IsLogStaticPattern<T>::value, const T &>::type passPattern(const T &p) {return p;}
+     template<typename T>
+     typename std::enable_if<!IsLogStaticPattern<T>::value, StrViewA>::type passPattern(const T &p) {return StrViewA(p);}
+
+     ///Returns text of the pattern
+     template<typename T>
+     typename std::enable_if<IsLogStaticPattern<T>::value, StrViewA>::type patternText(const T &) {return StrViewA(T::get(), T::size());}
+     template<typename T>
+     typename std::enable_if<!IsLogStaticPattern<T>::value, StrViewA>::type patternText(const T &p) {return StrViewA(p);}
+
+     ///Returns identification of the call site - address of the LOG_PATTERN, or nullptr for other patterns
+     template<typename T>
+     typename std::enable_if<IsLogStaticPattern<T>::value, const void *>::type patternSite(const T &) {return T::get();}
+     template<typename T>
+     typename std::enable_if<!IsLogStaticPattern<T>::value, const void *>::type patternSite(const T &) {return nullptr;}
+}
 
+///Formats the pattern parsed at compile time
+/**
+ * @param wr function which receives characters and strings
+ * @param pattern pattern declared by LOG_PATTERN
+ * @param args arguments for placeholders
+ */
+template<typename WriteFn, typename Pattern, typename... Args>
+typename std::enable_if<IsLogStaticPattern<Pattern>::value>::type
+logFormat(WriteFn &wr, const Pattern &, Args&&... args) {
+     constexpr std::size_t count = _logDetails::patternSegmentCount(Pattern::get(), Pattern::size());
+     auto argt = std::forward_as_tuple(std::forward<Args>(args)...);
+     _logDetails::renderSegments<Pattern>(wr, argt, std::make_index_sequence<count>());
+}
+
+namespace _logDetails {
+
+     ///Applies LogRateLimit to the message
+     /**
+      * @return true to log the message. If messages have been suppressed, the
+      * summary is logged before
+      */
+     inline bool rateLimitPass(AbstractLogProvider *p, LogLevel level, const StrViewA &pattern, const void *site) {
+          if (!p->isLogLevelEnabled(level)) return false;
+          std::size_t suppressed;
+          if (!LogRateLimit::admit(site, pattern.length, level, suppressed)) return false;
+          auto report = [&](LogLevel lv, std::size_t cnt, const StrViewA &pat) {
+               LogWriterFn wr(p, lv);
+               if (wr.enabled) logFormat(wr, StrViewA("Suppressed $1 messages: $2"), cnt, pat);
+          };
+          if (suppressed) report(level, suppressed, pattern);
+          LogRateLimit::reportSuppressed(report);
+          return true;
+     }
+}
+
+///Prints message to the log
+/**
+ * @param lp log provider
+ * @param level log level
+ * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders. It can
+ * be also pattern declared by LOG_PATTERN
+ * @param args arguments for placeholders
+ */
+template<typename Provider, typename Pattern, typename... Args>
+void logPrint(Provider &lp, LogLevel level, const Pattern &pattern, Args&&... args) {
+
+     if (lp == nullptr) return;
+
+     AbstractLogProvider *p = lp.get();
+     if (LogRateLimit::isActive() && !_logDetails::rateLimitPass(p, level,
+               _logDetails::patternText(pattern), _logDetails::patternSite(pattern))) return;
+     LogWriterFn wr(p,level);
+     if (wr.enabled) {
+          logFormat(wr, _logDetails::passPattern(pattern), std::forward<Args>(args)...);
+     }
 };
 
+namespace _logDetails {
+
+     ///Writer which appends the text to a string
+     class StringWriter {
+     public:
+          StringWriter(std::string &s):s(s) {}
+          void operator()(char c) const {s.push_back(c);}
+          void operator()(StrViewA str) const {s.append(str.data, str.length);}
+     protected:
+          std::string &s;
+     };
+
+     template<typename T>
+     char *captureValue(char *p, const T &v) {
+          std::memcpy(p, &v, sizeof(T));
+          return p + sizeof(T);
+     }
+
+     template<typename T>
+     T readCapturedValue(const char *&p) {
+          T v;
+          std::memcpy(&v, p, sizeof(T));
+          p += sizeof(T);
+          return v;
+     }
+
+     inline char *captureString(char *p, StrViewA s) {
+          p = captureValue(p, static_cast<std::uint32_t>(s.length));
+          std::memcpy(p, s.data, s.length);
+          return p + s.length;
+     }
+
+     inline StrViewA readCapturedString(const char *&p) {
+          std::uint32_t len = readCapturedValue<std::uint32_t>(p);
+          StrViewA s(p, len);
+          p += len;
+          return s;
+     }
+
+     template<typename T> struct IsCaptureString: std::false_type {};
+     template<> struct IsCaptureString<const char *>: std::true_type {};
+     template<> struct IsCaptureString<char *>: std::true_type {};
+     template<> struct IsCaptureString<StrViewA>: std::true_type {};
+     template<> struct IsCaptureString<std::string>: std::true_type {};
+
+     ///Type tag of the number stored in the captured message
+     /**
+      * b,h,i,l - signed integer 8,16,32,64 bits; B,H,I,L - unsigned integer;
+      * f - float, d - double, D - long double, p - pointer
+      */
+     template<typename T>
+     constexpr char captureNumberTag() {
+          return std::is_floating_point<T>::value
+                    ?(sizeof(T) == sizeof(float)?'f':sizeof(T) == sizeof(double)?'d':'D')
+               :std::is_pointer<T>::value?'p'
+               :(std::is_signed<T>::value?"bhil":"BHIL")[sizeof(T) == 1?0:sizeof(T) == 2?1:sizeof(T) == 4?2:3];
+     }
+
+     ///Describes, how the argument is stored in the captured message
+     /**
+      * Prepared - object constructed from the argument, it calculates size and writes the data
+      * Stored - type of the argument passed to the formatting
+      * tag - type tag of the stored data - 's' for string (32bit length + text), see captureNumberTag
+      *
+      * Other types than numbers, pointers and strings are rendered to the text during capture
+      */
+     template<typename T, typename = void>
+     struct CaptureArg {
+          static constexpr char tag = 's';
+          class Prepared {
+          public:
+               Prepared(const T &v) {StringWriter wr(s);logPrintValue(wr, v);}
+               std::size_t size() const {return sizeof(std::uint32_t)+s.length();}
+               char *write(char *p) const {return captureString(p, s);}
+          protected:
+               std::string s;
+          };
+          using Stored = StrViewA;
+          static Stored read(const char *&p) {return readCapturedString(p);}
+     };
+
+     ///Numbers and pointers (except strings) are stored as binary copy
+     template<typename T>
+     struct CaptureArg<T, typename std::enable_if<std::is_arithmetic<T>::value
+                    || (std::is_pointer<T>::value && !IsCaptureString<T>::value)>::type> {
+          static constexpr char tag = captureNumberTag<T>();
+          class Prepared {
+          public:
+               Prepared(const T &v):v(v) {}
+               std::size_t size() const {return sizeof(T);}
+               char *write(char *p) const {return captureValue(p, v);}
+          protected:
+               T v;
+          };
+          using Stored = T;
+          static Stored read(const char *&p) {return readCapturedValue<T>(p);}
+     };
+
+     ///Strings are copied
+     template<typename T>
+     struct CaptureArg<T, typename std::enable_if<IsCaptureString<T>::value>::type> {
+          static constexpr char tag = 's';
+          class Prepared {
+          public:
+               Prepared(const T &v):v(v) {}
+               std::size_t size() const {return sizeof(std::uint32_t)+v.length;}
+               char *write(char *p) const {return captureString(p, v);}
+          protected:
+               StrViewA v;
+          };
+          using Stored = StrViewA;
+          static Stored read(const char *&p) {return readCapturedString(p);}
+     };
+
+     using CaptureFormatFn = void (*)(const char *data, std::string &out);
+
+     ///Describes the captured message
+     /**
+      * The captured message starts with pointer to this structure, followed by
+      * the pointer to the pattern, its length and arguments
+      */
+     struct CaptureDesc {
+          ///function which formats the message (it receives data after the pointer)
+          CaptureFormatFn format;
+          ///tags of arguments (see CaptureArg::tag), zero terminated
+          const char *types;
+     };
+
+     ///Formats message captured with arguments of given types
+     template<typename... A>
+     struct CaptureFormat {
+          static constexpr char types[] = {CaptureArg<A>::tag..., 0};
+          static const CaptureDesc desc;
+
+          static void format(const char *data, std::string &out) {
+               const char *p = data;
+               const char *pattern = readCapturedValue<const char *>(p);
+               std::size_t patlen = readCapturedValue<std::size_t>(p);
+               //braced initialization guarantees the order of reading
+               std::tuple<typename CaptureArg<A>::Stored...> args{CaptureArg<A>::read(p)...};
+               StringWriter wr(out);
+               render(wr, StrViewA(pattern, patlen), args, std::index_sequence_for<A...>());
+          }
+          template<typename Tuple, std::size_t... idx>
+          static void render(StringWriter &wr, const StrViewA &pattern, Tuple &args, std::index_sequence<idx...>) {
+               logFormat(wr, pattern, std::get<idx>(args)...);
+          }
+     };
+
+     template<typename... A>
+     constexpr char CaptureFormat<A...>::types[];
+     template<typename... A>
+     const CaptureDesc CaptureFormat<A...>::desc = {&CaptureFormat<A...>::format, CaptureFormat<A...>::types};
+
+     inline std::size_t capturedSize() {return 0;}
+     template<typename P, typename... Ps>
+     std::size_t capturedSize(const P &p, const Ps &... ps) {return p.size()+capturedSize(ps...);}
+
+     inline char *captureArgs(char *p) {return p;}
+     template<typename P, typename... Ps>
+     char *captureArgs(char *p, const P &x, const Ps &... xs) {return captureArgs(x.write(p), xs...);}
+
+     ///Writes captured message to the provider
+     /**
+      * @return false, if the provider doesn't support the binary capture
+      */
+     template<typename Fmt, typename... P>
+     bool captureMessage(AbstractLogProvider *lp, LogLevel level, const StrViewA &pattern, const P &... prep) {
+          const CaptureDesc *desc = &Fmt::desc;
+          std::size_t sz = sizeof(desc) + sizeof(pattern.data) + sizeof(pattern.length) + capturedSize(prep...);
+          char *p = lp->startCapture(level, sz);
+          if (p == nullptr) return false;
+          p = captureValue(p, desc);
+          p = captureValue(p, pattern.data);
+          p = captureValue(p, pattern.length);
+          captureArgs(p, prep...);
+          lp->commitCapture();
+          return true;
+     }
+}
+
+///Logs message in the binary capture mode
+/**
+ * The message is not formatted by the calling thread. Only a pointer to the pattern and
+ * binary copy of the arguments (numbers, pointers, strings) are passed to the provider,
+ * which formats the message later (see logFormatCaptured). Arguments of other types
+ * are converted to the text immediately.
+ *
+ * If the provider doesn't support binary capture, the message is formatted as usual
+ *
+ * @param lp log provider
+ * @param level log level
+ * @param pattern pattern declared by LOG_PATTERN. Only the pointer to the pattern is
+ * stored, so other patterns (even char arrays) are not accepted, they can be
+ * temporary
+ * @param args arguments
+ *
+ * @code
+ * logPrintCaptured(lp, LogLevel::info, LOG_PATTERN("Received $1 bytes"), size);
+ * @endcode
+ */
+template<typename Provider, typename Pattern, typename... Args>
+typename std::enable_if<IsLogStaticPattern<Pattern>::value>::type
+logPrintCaptured(Provider &lp, LogLevel level, const Pattern &pattern, Args&&... args) {
+
+     using namespace _logDetails;
+
+     if (lp == nullptr || !lp->isLogLevelEnabled(level)) return;
+     StrViewA pat(Pattern::get(), Pattern::size());
+     if (LogRateLimit::isActive() && !rateLimitPass(lp.get(), level, pat, Pattern::get())) return;
+     if (!captureMessage<CaptureFormat<typename std::decay<Args>::type...> >(lp.get(), level, pat,
+               typename CaptureArg<typename std::decay<Args>::type>::Prepared(args)...)) {
+          LogWriterFn wr(lp.get(), level);
+          if (wr.enabled) logFormat(wr, pattern, std::forward<Args>(args)...);
+     }
+}
+
+///Formats message captured by logPrintCaptured
+/**
+ * @param data captured data - content of the buffer returned by AbstractLogProvider::startCapture
+ * @param out string, which receives the formatted message (the text is appended)
+ */
+inline void logFormatCaptured(const char *data, std::string &out) {
+     const char *p = data;
+     auto desc = _logDetails::readCapturedValue<const _logDetails::CaptureDesc *>(p);
+     desc->format(p, out);
+}
+
 
 ///Object purposed to perform log output to special sections disconnected to current thread
 /**
@@ -379,66 +1113,66 @@ class LogObjectT {
 
           ///Log to the output a fatal error
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void fatal(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void fatal(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::fatal, pattern, std::forward<Args>(args)...);
           }
           ///Log to the output a warning
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void warning(const StrViewA &pattern, Args&&... args)const  {
+          template<typename Pattern, typename... Args>
+          void warning(const Pattern &pattern, Args&&... args)const  {
                logPrint(lp,LogLevel::warning, pattern, std::forward<Args>(args)...);
           }
           ///Log to the output an error
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void error(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void error(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::error, pattern, std::forward<Args>(args)...);
           }
           ///Log to the output a note
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void note(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void note(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::note, pattern, std::forward<Args>(args)...);
           }
           ///Log to the output a prohress
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void progress(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void progress(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::progress, pattern, std::forward<Args>(args)...);
           }
           ///Log to the output an info
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void info(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void info(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::info, pattern, std::forward<Args>(args)...);
           }
 
           ///Log to the output a debug
           /**
-           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders
+           * @param pattern pattern, use $1...$n or $(1)...$(n) as placeholders (or LOG_PATTERN)
            * @param args arguments for placeholders
            */
-          template<typename... Args>
-          void debug(const StrViewA &pattern, Args&&... args) const {
+          template<typename Pattern, typename... Args>
+          void debug(const Pattern &pattern, Args&&... args) const {
                logPrint(lp,LogLevel::debug, pattern, std::forward<Args>(args)...);
           }
 
@@ -566,38 +1300,67 @@ class LogObjectT {
      };
 
 
-     template<typename... Args>
-     void logFatal(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::fatal, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logFatal(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::fatal))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::fatal, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logWarning(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::warning, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logWarning(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::warning))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::warning, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logError(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::error, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logError(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::error))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::error, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logNote(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::note, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logNote(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::note))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::note, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logProgress(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::progress, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logProgress(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::progress))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::progress, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logInfo(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::info, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logInfo(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::info))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::info, pattern, std::forward<Args>(args)...);
      }
-     template<typename... Args>
-     void logDebug(const StrViewA &pattern, Args&&... args) {
-          logPrint(AbstractLogProvider::initInstance(),LogLevel::debug, pattern, std::forward<Args>(args)...);
+     template<typename Pattern, typename... Args>
+     void logDebug(const Pattern &pattern, Args&&... args) {
+          if (LogLevelCache::isEnabled(LogLevel::debug))
+               logPrint(AbstractLogProvider::getInstance(),LogLevel::debug, pattern, std::forward<Args>(args)...);
      }
+     ///Log message in the binary capture mode (see logPrintCaptured), pattern must be declared by LOG_PATTERN
+     template<typename Pattern, typename... Args>
+     void logCaptured(LogLevel level, const Pattern &pattern, Args&&... args) {
+          static_assert(IsLogStaticPattern<Pattern>::value, "logCaptured requires pattern declared by LOG_PATTERN");
+          if (LogLevelCache::isEnabled(level))
+               logPrintCaptured(AbstractLogProvider::getInstance(),level, pattern, std::forward<Args>(args)...);
+     }
+
+///Logs message to the log of the current thread, arguments are evaluated only if the level is enabled
+/**
+ * @param level name of the level (debug, info, progress, note, warning, error, fatal)
+ *
+ * @code
+ * LOG_IF_ENABLED(debug, "State: $1", dumpState());
+ * @endcode
+ */
+#define LOG_IF_ENABLED(level, ...) do { \
+          if (::ondra_shared::LogLevelCache::isEnabled(::ondra_shared::LogLevel::level)) \
+               ::ondra_shared::logPrint(::ondra_shared::AbstractLogProvider::getInstance(), \
+                         ::ondra_shared::LogLevel::level, __VA_ARGS__); \
+     } while (false)
 
      inline void AbstractLogProviderFactory::setDefault() {
           getInstance() = this;
           AbstractLogProvider::getInstance() = create();
+          LogLevelCache::invalidate();
      }
 
      class LogLevelToStrTable {
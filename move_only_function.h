@@ -8,7 +8,13 @@
 #ifndef SRC_LIBS_SHARED_MOVE_ONLY_FUNCTION_H_
 #define SRC_LIBS_SHARED_MOVE_ONLY_FUNCTION_H_
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
 #include <type_traits>
+#include <utility>
 
 namespace ondra_shared {
 
@@ -29,71 +35,227 @@ namespace _details {
     public:
         template<typename T>
         using FP = FastParam<T>;
+
+        ///Count of identifications reserved by a thread at once
+        static constexpr std::uintptr_t ident_block = 256;
+
+        ///Generates identification of function stored inline
+        /** Identification is always odd number, so it never collides with a pointer
+         * to the heap. Every thread reserves a block of numbers, so the shared
+         * counter is updated only once per ident_block functions
+         */
+        static const void *new_inline_ident() {
+            static std::atomic<std::uintptr_t> counter = {0};
+            static thread_local std::uintptr_t next = 0;
+            static thread_local std::uintptr_t end = 0;
+            if (next == end) {
+                next = counter.fetch_add(ident_block, std::memory_order_relaxed);
+                end = next + ident_block;
+            }
+            return reinterpret_cast<const void *>((next++ << 1) | 1);
+        }
     };
-}
 
+    ///Implementation of move_only_function
+    /**
+     * Function object is stored inline if it fits to the inline buffer and it can be
+     * moved without exception. Otherwise it is allocated on the heap. The call is
+     * dispatched through a pointer to a function stored directly in the object
+     * (there is no virtual table). Functions which are trivially copyable
+     * (function pointers, lambdas capturing only pointers and numbers) are moved
+     * by memcpy and they are not destroyed.
+     *
+     * @tparam nx true if the function is noexcept
+     * @tparam inline_size size of inline buffer in bytes
+     */
+    template<bool nx, std::size_t inline_size, typename R, typename ... Args>
+    class move_only_function_impl: public move_only_function_details {
+    protected:
+
+        struct Storage {
+            union {
+                typename std::aligned_storage<inline_size, alignof(std::max_align_t)>::type buffer;
+                void *heap;
+            };
+        };
 
-template<typename T> class move_only_function;
+        using CallFn = R (*)(Storage &, FP<Args>... args) noexcept(nx);
+        using MoveFn = void (*)(Storage &dst, Storage &src) noexcept;
+        using DestroyFn = void (*)(Storage &) noexcept;
 
-template<typename R, typename ... Args, bool nx>
-class move_only_function<R(Args...) noexcept(nx)>: public _details::move_only_function_details {
+        template<typename Fn>
+        static constexpr bool is_inline() {
+            return sizeof(Fn) <= inline_size
+                    && alignof(Fn) <= alignof(std::max_align_t)
+                    && std::is_nothrow_move_constructible<Fn>::value;
+        }
 
-    class AbstractFn {
-    public:
-        virtual R call(FP<Args>... args) noexcept(nx) = 0;
-    };
+        template<typename Fn>
+        static constexpr bool is_trivial() {
+            return std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value;
+        }
+
+        template<typename Fn>
+        struct InlineOps {
+            static Fn &get(Storage &s) {return *reinterpret_cast<Fn *>(&s.buffer);}
+            static R call(Storage &s, FP<Args>... args) noexcept(nx) {
+                return R(get(s)(std::forward<FP<Args> >(args)...));
+            }
+            static void move(Storage &dst, Storage &src) noexcept {
+                new(&dst.buffer) Fn(std::move(get(src)));
+                get(src).~Fn();
+            }
+            static void destroy(Storage &s) noexcept {
+                get(s).~Fn();
+            }
+        };
+
+        template<typename Fn>
+        struct HeapOps {
+            static Fn &get(Storage &s) {return *reinterpret_cast<Fn *>(s.heap);}
+            static R call(Storage &s, FP<Args>... args) noexcept(nx) {
+                return R(get(s)(std::forward<FP<Args> >(args)...));
+            }
+            static void destroy(Storage &s) noexcept {
+                delete &get(s);
+            }
+        };
+
+        template<typename Fn>
+        static bool is_null(const Fn &) {return false;}
+        template<typename X>
+        static bool is_null(X *ptr) {return ptr == nullptr;}
 
-    template<typename Fn>
-    class CallFn: public AbstractFn {
     public:
-        virtual R call(FP<Args>... args) noexcept(nx) override  {
-            return R(fn(std::forward<FP<Args> >(args)...));
+
+        move_only_function_impl() = default;
+
+        template<typename Fn, typename = typename std::enable_if<
+                !std::is_base_of<move_only_function_details, typename std::decay<Fn>::type>::value
+            >::type>
+        move_only_function_impl(Fn &&fn) {
+            using FnT = typename std::decay<Fn>::type;
+            if (is_null(fn)) return;
+            if (is_inline<FnT>()) {
+                new(&_storage.buffer) FnT(std::forward<Fn>(fn));
+                _call = &InlineOps<FnT>::call;
+                if (!is_trivial<FnT>()) {
+                    _move = &InlineOps<FnT>::move;
+                    _destroy = &InlineOps<FnT>::destroy;
+                }
+                _ident = new_inline_ident();
+            } else {
+                _storage.heap = new FnT(std::forward<Fn>(fn));
+                _call = &HeapOps<FnT>::call;
+                _destroy = &HeapOps<FnT>::destroy;
+                _ident = _storage.heap;
+            }
         }
-        CallFn(Fn &&fn):fn(std::forward<Fn>(fn)) {}
-    protected:
-        Fn fn;
-    };
+        move_only_function_impl(std::nullptr_t) {};
 
-public:
+        move_only_function_impl(move_only_function_impl &&other) noexcept {
+            take(other);
+        }
+        move_only_function_impl &operator=(move_only_function_impl &&other) noexcept {
+            if (this != &other) {
+                clear();
+                take(other);
+            }
+            return *this;
+        }
+        move_only_function_impl &operator=(std::nullptr_t) noexcept {
+            clear();
+            return *this;
+        }
+
+        ~move_only_function_impl() {
+            clear();
+        }
 
-    move_only_function() = default;
+        move_only_function_impl(const move_only_function_impl &other) = delete;
+        move_only_function_impl &operator=(const move_only_function_impl &other) = delete;
 
-    template<typename Fn>
-    move_only_function(Fn &&fn)
-        :_ptr(std::make_unique<CallFn<Fn> >(std::forward<Fn>(fn))) {}
-    move_only_function(std::nullptr_t) {};
+        operator bool() const {return _call != nullptr;}
+        bool operator!() const {return _call == nullptr;}
 
-    move_only_function(move_only_function &&other) = default;
-    move_only_function &operator=(move_only_function &&other) = default;
+        bool operator==(std::nullptr_t) const {return _call == nullptr;}
+        bool operator!=(std::nullptr_t) const {return _call != nullptr;}
 
-    move_only_function(const move_only_function &other) = delete;
-    move_only_function(const move_only_function &&other) = delete;
-    move_only_function(move_only_function &other) = delete;
-    move_only_function &operator=(const move_only_function &other) = delete;
-    move_only_function &operator=(const move_only_function &&other) = delete;
-    move_only_function &operator=(move_only_function &other) = delete;
+        bool operator==(const move_only_function_impl &other) const {return _ident == other._ident;}
+        bool operator!=(const move_only_function_impl &other) const {return _ident != other._ident;}
 
-    operator bool() const {return _ptr != nullptr;}
-    bool operator!() const {return _ptr == nullptr;}
 
-    bool operator==(std::nullptr_t) const {return _ptr == nullptr;}
-    bool operator!=(std::nullptr_t) const {return _ptr != nullptr;}
+        R operator()(FP<Args>... args) const noexcept(nx) {
+            return _call(_storage, std::forward<FP<Args>>(args)...);
+        }
+        ///Retrieves identification of this function - can be used to find function in map
+        /**
+         * Identification is kept when the function is moved
+         */
+        const void *get_ident() const {
+            return _ident;
+        }
 
-    bool operator==(const move_only_function &other) const {return _ptr == other._ptr;}
-    bool operator!=(const move_only_function &other) const {return _ptr != other._ptr;}
+        ///Determines, whether function object of given type is stored inline
+        template<typename Fn>
+        static constexpr bool fits_inline() {
+            return is_inline<typename std::decay<Fn>::type>();
+        }
 
+    protected:
+        mutable Storage _storage;
+        CallFn _call = nullptr;
+        MoveFn _move = nullptr;
+        DestroyFn _destroy = nullptr;
+        const void *_ident = nullptr;
 
-    R operator()(FP<Args>... args) const noexcept(nx) {
-        return _ptr->call(std::forward<FP<Args>>(args)...);
-    }
-    ///Retrieves identification of this function - can be used to find function in map
-    const void *get_ident() const {
-        return _ptr.get();
-    }
+        void clear() noexcept {
+            if (_destroy) _destroy(_storage);
+            _call = nullptr;
+            _move = nullptr;
+            _destroy = nullptr;
+            _ident = nullptr;
+        }
 
-private:
-    std::unique_ptr<AbstractFn> _ptr;
+        void take(move_only_function_impl &other) noexcept {
+            if (other._move) other._move(_storage, other._storage);
+            else std::memcpy(&_storage, &other._storage, sizeof(_storage));
+            _call = other._call;
+            _move = other._move;
+            _destroy = other._destroy;
+            _ident = other._ident;
+            other._call = nullptr;
+            other._move = nullptr;
+            other._destroy = nullptr;
+            other._ident = nullptr;
+        }
+    };
+}
+
+
+///Function wrapper, which can hold move only function object
+/**
+ * @tparam T prototype of the function. It can be declared noexcept (C++17)
+ * @tparam inline_size size of inline buffer. Function objects, which fit to the buffer
+ * are not allocated on the heap.
+ */
+template<typename T, std::size_t inline_size = 2*sizeof(void *)> class move_only_function;
+
+template<typename R, typename ... Args, std::size_t inline_size>
+class move_only_function<R(Args...), inline_size>
+    : public _details::move_only_function_impl<false, inline_size, R, Args...> {
+public:
+    using _details::move_only_function_impl<false, inline_size, R, Args...>::move_only_function_impl;
+};
+
+#ifdef __cpp_noexcept_function_type
+template<typename R, typename ... Args, std::size_t inline_size>
+class move_only_function<R(Args...) noexcept, inline_size>
+    : public _details::move_only_function_impl<true, inline_size, R, Args...> {
+public:
+    using _details::move_only_function_impl<true, inline_size, R, Args...>::move_only_function_impl;
 };
+#endif
 
 
 
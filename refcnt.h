@@ -2,43 +2,186 @@
 #define __ONDRA_SHARED_REFCNT_H_qwopei2poekqskq2131231a
 
 #include <atomic>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <utility>
 
 namespace ondra_shared {
 
 
      template<typename T> class RefCntPtr;
+     template<typename T> class RefCntWeakPtr;
 
-     ///Simple refcounting 
-     /** Because std::shared_ptr is too heavy a bloated and slow and wastes a lot memory */
+     ///Reference counter policy - atomic counter (default)
+     /** Object can be shared between threads */
+     class RefCntAtomic {
+     public:
+          RefCntAtomic():counter(0) {}
+          void addRef() noexcept {
+               //new reference doesn't need anything from other threads
+               counter.fetch_add(1, std::memory_order_relaxed);
+          }
+          bool release() noexcept {
+               //all writes must be done before the object is destroyed by other thread
+               return counter.fetch_sub(1, std::memory_order_acq_rel) == 1;
+          }
+          long use_count() const noexcept {
+               return counter.load(std::memory_order_relaxed);
+          }
+     protected:
+          std::atomic_long counter;
+     };
+
+     ///Reference counter policy - non-atomic counter
+     /** Object must not leave the thread, where it has been created */
+     class RefCntSingleThread {
+     public:
+          RefCntSingleThread():counter(0) {}
+          RefCntSingleThread(const RefCntSingleThread &) = delete;
+          RefCntSingleThread &operator=(const RefCntSingleThread &) = delete;
+          void addRef() noexcept {
+               ++counter;
+          }
+          bool release() noexcept {
+               return --counter == 0;
+          }
+          long use_count() const noexcept {
+               return counter;
+          }
+     protected:
+          long counter;
+     };
 
-     class RefCntObj {
+     ///Simple refcounting 
+     /** Because std::shared_ptr is too heavy a bloated and slow and wastes a lot memory
+      *
+      * @tparam Policy reference counter policy: RefCntAtomic or RefCntSingleThread.
+      * Use RefCntObj for default policy
+      * */
+     template<typename Policy>
+     class RefCntObjT {
      public:
 
           void addRef() const noexcept {
-               ++counter;
+               counter.addRef();
           }
 
           bool release() const noexcept {
-               return --counter == 0;
+               return counter.release();
           }
 
-          RefCntObj():counter(0) {}
+          RefCntObjT() {}
 
           bool isShared() const {
-               return counter > 1;
+               return counter.use_count() > 1;
           }
 
           long use_count() const noexcept {
-               return counter;
+               return counter.use_count();
           }
 
      protected:
-          mutable std::atomic_long counter;
+          mutable Policy counter;
 
 
           template<typename T> friend class RefCntPtr;
      };
 
+     ///Reference counted object with atomic counter
+     using RefCntObj = RefCntObjT<RefCntAtomic>;
+
+
+     template<typename T, typename ... Args> RefCntPtr<T> make_weak(Args && ... args);
+
+     ///Reference counted object which supports weak references (RefCntWeakPtr)
+     /**
+      * Use this class instead of RefCntObj when weak references are needed. Counters are
+      * stored in a header allocated along with the object (there is still one allocation
+      * per object). When last strong reference is released, the object is destroyed, but
+      * its memory is released after the last weak reference is released.
+      *
+      * Object must be created by the function make_weak(). Operator new is deleted, so
+      * the object cannot be allocated by other way. Object which was not created by
+      * make_weak() (for example an object on the stack) cannot be referenced, an attempt
+      * to do so terminates the program.
+      *
+      * @code
+      * RefCntPtr<Foo> foo = make_weak<Foo>(1,2,3);
+      * RefCntWeakPtr<Foo> wk = foo;
+      * @endcode
+      */
+     class RefCntWeakObj {
+     public:
+
+          void addRef() const noexcept {
+               control()->strong.fetch_add(1, std::memory_order_relaxed);
+          }
+
+          bool release() const noexcept {
+               return control()->strong.fetch_sub(1, std::memory_order_acq_rel) == 1;
+          }
+
+          bool isShared() const {
+               return use_count() > 1;
+          }
+
+          long use_count() const noexcept {
+               return _ctl?_ctl->strong.load(std::memory_order_relaxed):0;
+          }
+
+          RefCntWeakObj():_ctl(nullptr) {}
+          RefCntWeakObj(const RefCntWeakObj &) = delete;
+          RefCntWeakObj &operator=(const RefCntWeakObj &) = delete;
+
+          ///Use make_weak() to create the object
+          static void *operator new(std::size_t sz) = delete;
+
+          static void operator delete(void *ptr) noexcept {
+               Control *c = reinterpret_cast<Control *>(ptr)-1;
+               //strong references hold one weak reference together
+               c->release_weak();
+          }
+
+     protected:
+
+          ///Header placed before the object
+          struct alignas(std::max_align_t) Control {
+               std::atomic_long strong = {0};
+               std::atomic_long weak = {1};
+
+               void add_weak() noexcept {
+                    weak.fetch_add(1, std::memory_order_relaxed);
+               }
+               void release_weak() noexcept {
+                    if (weak.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                         this->~Control();
+                         ::operator delete(this);
+                    }
+               }
+               ///Acquire strong reference, if object still exists
+               bool try_add_strong() noexcept {
+                    long s = strong.load(std::memory_order_relaxed);
+                    while (s > 0) {
+                         if (strong.compare_exchange_weak(s, s+1, std::memory_order_relaxed)) return true;
+                    }
+                    return false;
+               }
+          };
+
+          ///Header of the object, it is assigned by make_weak() after the object is constructed
+          Control *_ctl;
+
+          Control *control() const noexcept {
+               //object was not created by make_weak()
+               if (_ctl == nullptr) std::terminate();
+               return _ctl;
+          }
+
+          template<typename T> friend class RefCntWeakPtr;
+          template<typename T, typename ... Args> friend RefCntPtr<T> make_weak(Args && ... args);
+     };
+
 
 
 
@@ -107,6 +250,8 @@ namespace ondra_shared {
      protected:
           T *ptr;
 
+          template<typename X> friend class RefCntWeakPtr;
+
           void addRefPtr() noexcept {
                if (ptr) ptr->addRef();
           }
@@ -120,6 +265,101 @@ namespace ondra_shared {
           }
      };
 
+
+     ///Weak reference to an object derived from RefCntWeakObj
+     /**
+      * Weak reference doesn't keep the object alive. Use lock() to obtain strong reference.
+      * Function lock() is lock-free
+      */
+     template<typename T>
+     class RefCntWeakPtr {
+     public:
+
+          RefCntWeakPtr():ptr(nullptr),ctl(nullptr) {}
+          RefCntWeakPtr(const RefCntPtr<T> &other):RefCntWeakPtr(other.ptr) {}
+          RefCntWeakPtr(T *obj):ptr(obj),ctl(obj?obj->RefCntWeakObj::control():nullptr) {
+               if (ctl) ctl->add_weak();
+          }
+          RefCntWeakPtr(const RefCntWeakPtr &other):ptr(other.ptr),ctl(other.ctl) {
+               if (ctl) ctl->add_weak();
+          }
+          RefCntWeakPtr(RefCntWeakPtr &&other):ptr(other.ptr),ctl(other.ctl) {
+               other.ptr = nullptr;
+               other.ctl = nullptr;
+          }
+          ~RefCntWeakPtr() {
+               if (ctl) ctl->release_weak();
+          }
+
+          RefCntWeakPtr &operator=(const RefCntWeakPtr &other) {
+               if (other.ctl != ctl) {
+                    if (other.ctl) other.ctl->add_weak();
+                    if (ctl) ctl->release_weak();
+                    ptr = other.ptr;
+                    ctl = other.ctl;
+               }
+               return *this;
+          }
+          RefCntWeakPtr &operator=(RefCntWeakPtr &&other) {
+               if (this != &other) {
+                    if (ctl) ctl->release_weak();
+                    ptr = other.ptr;
+                    ctl = other.ctl;
+                    other.ptr = nullptr;
+                    other.ctl = nullptr;
+               }
+               return *this;
+          }
+
+          ///Obtain strong reference
+          /**
+           * @return strong reference, or nullptr, if the object has been already destroyed
+           */
+          RefCntPtr<T> lock() const noexcept {
+               RefCntPtr<T> out;
+               if (ctl && ctl->try_add_strong()) out.ptr = ptr;
+               return out;
+          }
+
+          ///Determines whether object has been destroyed
+          bool expired() const noexcept {
+               return ctl == nullptr || ctl->strong.load(std::memory_order_relaxed) == 0;
+          }
+
+          bool operator==(std::nullptr_t) const noexcept { return ctl == nullptr; }
+          bool operator!=(std::nullptr_t) const noexcept { return ctl != nullptr; }
+          bool operator==(const RefCntWeakPtr &other) const noexcept { return ctl == other.ctl; }
+          bool operator!=(const RefCntWeakPtr &other) const noexcept { return ctl != other.ctl; }
+
+     protected:
+          T *ptr;
+          RefCntWeakObj::Control *ctl;
+     };
+
+     ///Creates object derived from RefCntWeakObj
+     /**
+      * @tparam T type of object
+      * @param args arguments passed to the constructor
+      * @return strong reference to the object
+      */
+     template<typename T, typename ... Args>
+     RefCntPtr<T> make_weak(Args && ... args) {
+          using Control = RefCntWeakObj::Control;
+          static_assert(alignof(T) <= alignof(Control), "Overaligned objects are not supported");
+          void *mem = ::operator new(sizeof(Control) + sizeof(T));
+          Control *c = new(mem) Control;
+          T *obj;
+          try {
+               obj = ::new(c+1) T(std::forward<Args>(args)...);
+          } catch (...) {
+               c->~Control();
+               ::operator delete(mem);
+               throw;
+          }
+          static_cast<RefCntWeakObj *>(obj)->_ctl = c;
+          return RefCntPtr<T>(obj);
+     }
+
 }
 
 #endif
@@ -99,18 +99,22 @@ auto lambda_state(Args && ... args) {
  *
  * shared_function is not copied, it is shared, so its internal state is kept
  * between copies.
+ *
+ * @tparam Proto prototype of the function
+ * @tparam RefCntPolicy policy of reference counter (see RefCntObjT). Use RefCntSingleThread
+ * if the function never leaves its thread.
  */
 
-template<typename Proto>
+template<typename Proto, typename RefCntPolicy = RefCntAtomic>
 class shared_function;
 
 
 
-template<typename Ret, typename ... Args>
-class shared_function<Ret(Args...)> {
+template<typename Ret, typename ... Args, typename RefCntPolicy>
+class shared_function<Ret(Args...), RefCntPolicy> {
 private:
 
-     class FnWrapBase: public RefCntObj {
+     class FnWrapBase: public RefCntObjT<RefCntPolicy> {
      public:
           virtual Ret call(const shared_function &self, _details::ForceReference_t<Args> ...args) const = 0;
           virtual ~FnWrapBase() {}
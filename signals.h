@@ -5,16 +5,146 @@
  *      Author: ondra
  */
 
-#ifndef SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwq[pqod
-#define SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwq[pqod
+#ifndef SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwqpqod
+#define SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwqpqod
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include "move_only_function.h"
 #include "fastparam.h"
+#include "refcnt.h"
+#include "stringview.h"
 
 namespace ondra_shared {
 
 
 template<typename T> class Signal;
+template<typename T> class MTSignal;
+
+namespace _details {
+    template<typename ... Args>
+    struct SignalBatchItem {
+        using T = std::tuple<typename std::decay<Args>::type...>;
+        template<std::size_t idx>
+        static const typename std::tuple_element<idx, T>::type &get(const T &itm) {
+            return std::get<idx>(itm);
+        }
+    };
+    template<typename Arg>
+    struct SignalBatchItem<Arg> {
+        using T = typename std::decay<Arg>::type;
+        template<std::size_t idx>
+        static const T &get(const T &itm) {return itm;}
+    };
+
+    ///Hazard pointers used by the MTSignal
+    /**
+     * Every thread protects the snapshot it is reading by storing its address to
+     * a hazard record owned by the thread. The writer releases the old snapshot only when
+     * it is not stored in any record, otherwise it keeps it for the next write.
+     * Records are allocated once and reused by other threads after the owning thread exits
+     */
+    class SignalHazard {
+    public:
+
+        struct Record {
+            ///protected pointer
+            std::atomic<const void *> ptr = {nullptr};
+            ///record is owned by a thread
+            std::atomic<bool> used = {true};
+            ///next record in the list, never changes once published
+            Record *next = nullptr;
+            ///fills the cache line, so records of different threads don't share it
+            char padding[64 - 3*sizeof(void *)];
+        };
+
+        ///Protects pointer stored in an atomic variable
+        template<typename T>
+        class Guard {
+        public:
+            Guard(const std::atomic<T *> &src):rec(acquire()) {
+                T *p = src.load(std::memory_order_acquire);
+                for(;;) {
+                    rec->ptr.store(p);
+                    T *q = src.load();
+                    if (q == p) break;
+                    p = q;
+                }
+                ptr = p;
+            }
+            ~Guard() {
+                rec->ptr.store(nullptr, std::memory_order_release);
+                release(rec);
+            }
+            Guard(const Guard &) = delete;
+            Guard &operator=(const Guard &) = delete;
+
+            T *get() const {return ptr;}
+            T *operator->() const {return ptr;}
+            bool operator==(std::nullptr_t) const {return ptr == nullptr;}
+            bool operator!=(std::nullptr_t) const {return ptr != nullptr;}
+        protected:
+            Record *rec;
+            T *ptr;
+        };
+
+        ///Collects all protected pointers
+        static void collect(std::vector<const void *> &out) {
+            for (Record *r = head().load(std::memory_order_acquire); r; r = r->next) {
+                const void *p = r->ptr.load();
+                if (p) out.push_back(p);
+            }
+        }
+
+    protected:
+
+        ///Records owned by the current thread, which are not in use
+        struct Pool {
+            std::vector<Record *> free;
+            ~Pool() {
+                for (Record *r: free) r->used.store(false, std::memory_order_release);
+            }
+        };
+
+        static std::atomic<Record *> &head() {
+            static std::atomic<Record *> h = {nullptr};
+            return h;
+        }
+
+        static Pool &pool() {
+            static thread_local Pool p;
+            return p;
+        }
+
+        static Record *acquire() {
+            Pool &p = pool();
+            if (!p.free.empty()) {
+                Record *r = p.free.back();
+                p.free.pop_back();
+                return r;
+            }
+            for (Record *r = head().load(std::memory_order_acquire); r; r = r->next) {
+                bool f = false;
+                if (!r->used.load(std::memory_order_relaxed)
+                        && r->used.compare_exchange_strong(f, true, std::memory_order_acquire)) return r;
+            }
+            Record *r = new Record;
+            Record *h = head().load(std::memory_order_relaxed);
+            do {
+                r->next = h;
+            } while (!head().compare_exchange_weak(h, r, std::memory_order_release, std::memory_order_relaxed));
+            return r;
+        }
+
+        static void release(Record *r) {
+            pool().free.push_back(r);
+        }
+    };
+}
 
 
 
@@ -34,9 +164,18 @@ public:
 
     using Fn = move_only_function<bool(Args...) noexcept>;
     using Connection = const void *;
+    ///Type of one item of a batch
+    /** For signal with single argument it is the type of the argument, otherwise
+     * it is std::tuple of all arguments
+     */
+    using BatchItem = typename _details::SignalBatchItem<Args...>::T;
+    ///Batch of items - a view to an array of items
+    using Batch = StringView<BatchItem>;
+    ///Slot which receives whole batch at once
+    using BatchFn = move_only_function<bool(Batch) noexcept>;
 
     ///Construct empty collector
-    Signal();
+    Signal() = default;
     ///Move constructor
     Signal(Signal &&other):fns(std::move(other.fns)) {}
     ///Assign operator
@@ -56,7 +195,20 @@ public:
      */
     Connection connect(Fn &&fn) {
         Connection out = fn.get_ident();
-        fns.push_back(std::move(fn));
+        fns.push_back(Slot{std::move(fn), nullptr});
+        return out;
+    }
+
+    ///Connects new slot which receives batches
+    /**
+     * @param fn function to connect. The function receives whole batch sent
+     * by send_batch() in one call. A signal sent by send() is delivered as
+     * a batch of one item (arguments are copied to the item)
+     * @return connection identifier.
+     */
+    Connection connect_batch(BatchFn &&fn) {
+        Connection out = fn.get_ident();
+        fns.push_back(Slot{nullptr, std::move(fn)});
         return out;
     }
 
@@ -67,8 +219,8 @@ public:
      * @retval false not found
      */
     bool disconnect(Connection con) {
-        auto iter = std::remove_if(fns.begin(), fns.end(), [&](const Fn &f) {
-           return f.get_ident() == con;
+        auto iter = std::remove_if(fns.begin(), fns.end(), [&](const Slot &f) {
+           return f.ident() == con;
         });
         if (iter != fns.end()) {
             fns.erase(iter, fns.end());
@@ -84,10 +236,44 @@ public:
      * @retval true some function is still connected
      * @retval false no connections
      **/
-    bool send(FastParamT<Args> ... args) const {
+    bool send(FastParam<Args> ... args) const {
+        auto iter = fns.begin();
+        while (iter != fns.end()) {
+            bool r;
+            if (iter->batch) {
+                BatchItem item(args...);
+                r = iter->batch(Batch(&item, 1));
+            } else {
+                r = iter->fn(std::forward<FastParam<Args> >(args)...);
+            }
+            if (!r) iter = fns.erase(iter);
+            else ++iter;
+        }
+        return !fns.empty();
+    }
+
+    ///Send batch of signals
+    /**
+     * Slots connected by connect_batch() receive whole batch in one call. Other
+     * slots are called for each item. If such slot returns false, it is
+     * disconnected and it doesn't receive rest of the batch
+     *
+     * @param items items to send
+     * @retval true some function is still connected
+     * @retval false no connections
+     */
+    bool send_batch(Batch items) const {
         auto iter = fns.begin();
         while (iter != fns.end()) {
-            bool r = (*iter)(std::forward<FastParamT<Args> >(args)...);
+            bool r = true;
+            if (iter->batch) {
+                r = iter->batch(items);
+            } else {
+                for (const BatchItem &itm: items) {
+                    r = call_item(iter->fn, itm, std::index_sequence_for<Args...>());
+                    if (!r) break;
+                }
+            }
             if (!r) iter = fns.erase(iter);
             else ++iter;
         }
@@ -101,8 +287,8 @@ public:
      * @retval true some function is still connected
      * @retval false no connections
      **/
-    bool operator()(FastParamT<Args> ... args) const {
-        return send(std::forward<FastParamT<Args> >(args)...);
+    bool operator()(FastParam<Args> ... args) const {
+        return send(std::forward<FastParam<Args> >(args)...);
     }
 
     ///Determines whether connection is still established
@@ -112,8 +298,8 @@ public:
      * @retval false disconnected
      */
     bool is_connected(Connection conn) {
-        auto iter = std::find_if(fns.begin(), fns.end(),[&](const Fn &fn) {
-            return fn.get_ident() == conn;
+        auto iter = std::find_if(fns.begin(), fns.end(),[&](const Slot &fn) {
+            return fn.ident() == conn;
         });
         return iter != fns.end();
     }
@@ -124,15 +310,216 @@ public:
 
 protected:
 
-    std::vector<Fn> fns;
+    ///Connected slot - only one of the functions is set
+    struct Slot {
+        Fn fn;
+        BatchFn batch;
+        Connection ident() const {return batch?batch.get_ident():fn.get_ident();}
+    };
+
+    mutable std::vector<Slot> fns;
+
+    template<std::size_t ... idx>
+    static bool call_item(const Fn &fn, const BatchItem &itm, std::index_sequence<idx...>) {
+        return fn(_details::SignalBatchItem<Args...>::template get<idx>(itm)...);
+    }
 };
 
 
 
+
+///Thread safe variant of the Signal
+/**
+ * Slots are stored in an immutable snapshot. Emitting the signal protects current
+ * snapshot by a hazard pointer of the thread and calls slots without any locking and
+ * without writing to shared variables, so signal can be emitted from many threads at
+ * once. Connect and disconnect create new snapshot and publish it. They never wait for
+ * emitting threads. The old snapshot is released by the same or a next write, once it is
+ * no longer used by any emit.
+ *
+ * Slots which returned false are marked as disconnected and they are skipped. They
+ * are removed from the snapshot lazily, by the next emit.
+ *
+ * @note slot can be called concurrently from many threads, if the signal is emitted
+ * concurrently. Slot can be also called once more after it returned false, if it was
+ * already being called by other thread. Slot can connect or disconnect slots of the
+ * same signal.
+ */
+template<typename ... Args>
+class MTSignal<bool(Args...)> {
+public:
+
+    using Fn = move_only_function<bool(Args...) noexcept>;
+    using Connection = const void *;
+
+    MTSignal():cur(nullptr) {}
+    ~MTSignal() {
+        delete cur.load(std::memory_order_relaxed);
+        for (Snapshot *s: retired) delete s;
+    }
+    MTSignal(const MTSignal &) = delete;
+    MTSignal &operator=(const MTSignal &) = delete;
+
+    ///Connects new slot
+    /**
+     * @param fn function to connect
+     * @return connection identifier
+     */
+    Connection connect(Fn &&fn) {
+        PSlot sl = new Slot(std::move(fn));
+        std::lock_guard<std::mutex> _(wrmx);
+        const Snapshot *s = cur.load(std::memory_order_relaxed);
+        std::unique_ptr<Snapshot> n(new Snapshot);
+        if (s != nullptr) {
+            n->slots.reserve(s->slots.size()+1);
+            copy_active(*s, *n);
+        }
+        n->slots.push_back(sl);
+        publish(n.release());
+        return static_cast<const Slot *>(sl);
+    }
+
+    ///Disconnects connected slot
+    /**
+     * @param con connection identifier
+     * @retval true disconnected
+     * @retval false not found
+     */
+    bool disconnect(Connection con) {
+        std::lock_guard<std::mutex> _(wrmx);
+        const Snapshot *s = cur.load(std::memory_order_relaxed);
+        if (s == nullptr) return false;
+        auto iter = std::find_if(s->slots.begin(), s->slots.end(), [&](const PSlot &sl){
+            return static_cast<const Slot *>(sl) == con && sl->active.load(std::memory_order_relaxed);
+        });
+        if (iter == s->slots.end()) return false;
+        (*iter)->active.store(false, std::memory_order_relaxed);
+        publish(make_active(*s));
+        return true;
+    }
+
+    ///Send signal
+    /***
+     * @param args arguments of signal
+     * @retval true some function is still connected
+     * @retval false no connections
+     **/
+    bool send(FastParam<Args> ... args) const {
+        Guard s(cur);
+        if (s == nullptr) return false;
+        bool dirty = false;
+        bool any = false;
+        for (const PSlot &sl: s->slots) {
+            if (sl->active.load(std::memory_order_relaxed)) {
+                if (sl->fn(std::forward<FastParam<Args> >(args)...)) {
+                    any = true;
+                } else {
+                    sl->active.store(false, std::memory_order_relaxed);
+                    dirty = true;
+                }
+            } else {
+                dirty = true;
+            }
+        }
+        if (dirty) cleanup();
+        return any;
+    }
+
+    ///Send signal
+    /***
+     * @param args arguments of signal
+     * @retval true some function is still connected
+     * @retval false no connections
+     **/
+    bool operator()(FastParam<Args> ... args) const {
+        return send(std::forward<FastParam<Args> >(args)...);
+    }
+
+    ///Determines whether connection is still established
+    bool is_connected(Connection conn) const {
+        Guard s(cur);
+        if (s == nullptr) return false;
+        return std::any_of(s->slots.begin(), s->slots.end(), [&](const PSlot &sl){
+            return static_cast<const Slot *>(sl) == conn && sl->active.load(std::memory_order_relaxed);
+        });
+    }
+
+    bool empty() const {return size() == 0;}
+    std::size_t size() const {
+        Guard s(cur);
+        if (s == nullptr) return 0;
+        return std::count_if(s->slots.begin(), s->slots.end(), [&](const PSlot &sl){
+            return sl->active.load(std::memory_order_relaxed);
+        });
+    }
+    void clear() {
+        std::lock_guard<std::mutex> _(wrmx);
+        publish(nullptr);
+    }
+
+protected:
+
+    class Slot: public RefCntObj {
+    public:
+        Slot(Fn &&fn):fn(std::move(fn)) {}
+        Fn fn;
+        std::atomic<bool> active = {true};
+    };
+    using PSlot = RefCntPtr<Slot>;
+
+    class Snapshot {
+    public:
+        std::vector<PSlot> slots;
+    };
+    using Guard = _details::SignalHazard::Guard<Snapshot>;
+
+    ///current snapshot
+    mutable std::atomic<Snapshot *> cur;
+    ///old snapshots, which were still used by an emit when they were replaced (guarded by wrmx)
+    mutable std::vector<Snapshot *> retired;
+    ///serializes writers
+    mutable std::mutex wrmx;
+
+    ///Publish new snapshot and release old snapshots, which are no longer used (must hold wrmx)
+    void publish(Snapshot *n) const {
+        Snapshot *old = cur.exchange(n);
+        if (old) retired.push_back(old);
+        std::vector<const void *> hazards;
+        _details::SignalHazard::collect(hazards);
+        auto e = std::remove_if(retired.begin(), retired.end(), [&](Snapshot *s){
+            if (std::find(hazards.begin(), hazards.end(), s) != hazards.end()) return false;
+            delete s;
+            return true;
+        });
+        retired.erase(e, retired.end());
+    }
+
+    static void copy_active(const Snapshot &src, Snapshot &trg) {
+        for (const PSlot &sl: src.slots) {
+            if (sl->active.load(std::memory_order_relaxed)) trg.slots.push_back(sl);
+        }
+    }
+
+    ///Creates snapshot of active slots, returns nullptr if there is no active slot
+    static Snapshot *make_active(const Snapshot &src) {
+        std::unique_ptr<Snapshot> n(new Snapshot);
+        copy_active(src, *n);
+        return n->slots.empty()?nullptr:n.release();
+    }
+
+    ///Removes disconnected slots. If other thread is writing, the cleanup is skipped
+    void cleanup() const {
+        std::unique_lock<std::mutex> lk(wrmx, std::try_to_lock);
+        if (!lk.owns_lock()) return;
+        const Snapshot *s = cur.load(std::memory_order_relaxed);
+        if (s == nullptr) return;
+        publish(make_active(*s));
+    }
+};
 }
 
 
 
 
 
-#endif /* SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwq[pqod */
+#endif /* SRC_LIBS_SHARED_SIGNALS_H_129sopiqwjs12098ew1jisj1sqwdwqpqod */
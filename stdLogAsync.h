@@ -0,0 +1,602 @@
+/*
+ * stdLogAsync.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef _ONDRA_SHARED_STDLOGASYNC_H_8230918230981
+#define _ONDRA_SHARED_STDLOGASYNC_H_8230918230981
+
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "stdLogOutput.h"
+
+namespace ondra_shared {
+
+///Asynchronous log to a file
+/**
+ * Log lines are not written by the thread which logs. Every thread which logs has own
+ * lock-free ring buffer (single producer - single consumer), which is shared by all
+ * log providers and sections used by the thread. The dedicated writer thread drains
+ * all rings and writes lines to the file by writev() in batches.
+ *
+ * Lines logged by one thread are always written in order. Lines from different
+ * threads can be slightly reordered.
+ *
+ * Messages logged by logPrintCaptured() are stored to the ring in the binary form
+ * (pattern and arguments) and they are formatted by the writer thread.
+ *
+ * @note available on POSIX platforms
+ */
+class StdLogFileAsync: public StdLogProviderFactory {
+public:
+
+     ///What to do when the ring of the thread is full
+     enum class OverflowPolicy {
+          ///the thread waits until writer releases space
+          block,
+          ///the line is dropped. Count of dropped lines is reported in the log
+          drop
+     };
+
+     ///Construct async log
+     /**
+      * @param pathname pathname of the log file. If empty, the stderr is used
+      * @param minLevel minimum allowed log level
+      * @param policy overflow policy
+      * @param ringSize size of the ring buffer of every thread in bytes. It is rounded
+      * up to the power of two
+      */
+     StdLogFileAsync(StrViewA pathname,
+               LogLevel minLevel = LogLevel::info,
+               OverflowPolicy policy = OverflowPolicy::block,
+               std::size_t ringSize = 65536)
+          :StdLogProviderFactory(minLevel)
+          ,pathname(pathname)
+          ,policy(policy)
+          ,ringSize(roundSize(ringSize))
+          ,autorotate_count(0)
+          ,instanceId(nextInstanceId())
+     {
+          AbstractLogProvider::rotated(autorotate_count);
+          openLog();
+          writer = std::thread([this]{worker();});
+     }
+
+     ~StdLogFileAsync() {
+          {
+               std::lock_guard<std::mutex> _(wrmx);
+               stopping.store(true);
+          }
+          wrcond.notify_all();
+          writer.join();
+          {
+               //threads release their rings of this log on their next lookup
+               std::lock_guard<std::mutex> _(ringsmx);
+               for (const PRing &r: rings) r->detached.store(true, std::memory_order_release);
+          }
+          int f = fd.load();
+          if (f > 2) ::close(f);
+     }
+
+     bool operator! () const {
+          return fd < 0;
+     }
+
+     operator bool() const {
+          return fd >= 0;
+     }
+
+     void setCurrent() {
+          AbstractLogProviderFactory::getInstance() = this;
+          AbstractLogProvider::getInstance() = create();
+     }
+
+     virtual PLogProvider create() override {
+          return PLogProvider(new Provider(this));
+     }
+
+     ///Writes line synchronously - used only when someone calls sendToLog() directly
+     virtual void writeToLog(const StrViewA &line, const std::time_t &, LogLevel ) override {
+          StrViewA parts[2] = {line, "\n"};
+          writeParts(parts, 2);
+     }
+
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &, LogLevel ) override {
+          StrViewA nl("\n");
+          writeParts(parts, count);
+          writeParts(&nl, 1);
+     }
+
+     ///Returns count of dropped lines since start
+     std::size_t getDropped() const {
+          return totalDropped.load(std::memory_order_relaxed);
+     }
+
+     ///Waits until all lines logged before this call are written
+     void flush() {
+          std::vector<PRing> rs = getRings();
+          std::vector<std::uint64_t> marks;
+          for (const PRing &r: rs) marks.push_back(r->head.load(std::memory_order_acquire));
+          for (std::size_t i = 0; i < rs.size(); i++) {
+               const Ring &r = *rs[i];
+               std::uint64_t m = marks[i];
+               waitForWriter([&]{return r.tail.load() >= m;});
+          }
+     }
+
+     ///Create async log
+     /**
+      * @param pathname pathname to file, if empty, stderr is used
+      * @param minLevel minimal level
+      * @param policy overflow policy
+      * @return log provider
+      */
+     static PStdLogProviderFactory create(StrViewA pathname, LogLevel minLevel,
+                                   OverflowPolicy policy = OverflowPolicy::block) {
+          return new StdLogFileAsync(pathname, minLevel, policy);
+     }
+
+
+protected:
+
+     ///Ring buffer of single thread
+     /** Records are aligned to 8 bytes, each record starts with 32 bit length */
+     class Ring: public RefCntObj {
+     public:
+          Ring(std::size_t size, unsigned int ownerId):size(size),ownerId(ownerId),buffer(new char[size]) {}
+
+          const std::size_t size;
+          ///instanceId of the log
+          const unsigned int ownerId;
+          std::unique_ptr<char[]> buffer;
+          ///write position (only producer writes)
+          std::atomic<std::uint64_t> head = {0};
+          ///keeps positions in different cache lines
+          char padding[64];
+          ///read position (only writer thread writes)
+          std::atomic<std::uint64_t> tail = {0};
+          ///set when producer is gone, the ring is removed once it is empty
+          std::atomic<bool> closed = {false};
+          ///set when the log is destroyed, the thread releases the ring
+          std::atomic<bool> detached = {false};
+     };
+     using PRing = RefCntPtr<Ring>;
+
+     ///Rings of the current thread, one for each log. They are closed when the thread exits
+     class ThreadRings {
+     public:
+          ~ThreadRings() {
+               threadAlive() = false;
+               for (const PRing &r: rings) r->closed.store(true, std::memory_order_release);
+          }
+          std::vector<PRing> rings;
+     };
+
+     static constexpr std::uint32_t wrapMark = 0xFFFFFFFF;
+     ///flag in the length, record contains captured message (header + captured data)
+     static constexpr std::uint32_t capturedFlag = 0x80000000;
+     static constexpr std::size_t hdrSize = sizeof(std::uint32_t);
+
+     class Provider: public StdLogProvider {
+     public:
+          Provider(StdLogFileAsync *owner)
+               :StdLogProvider(owner),owner(owner) {}
+          Provider(const Provider &other, StrViewA ident)
+               :StdLogProvider(other, ident),owner(other.owner) {}
+
+          virtual void commit(const MutableStrViewA &text) override {
+               finishBuffer(text);
+               buffer.push_back('\n');
+               const std::vector<StrViewA> &parts = buffer.getParts();
+               owner->push(parts.data(), parts.size(), 0);
+               buffer.clear();
+          }
+          ///Captured record: 32 bit length of the header, the header and the captured data
+          virtual char *startCapture(LogLevel level, std::size_t size) override {
+               if (!StdLogProvider::isLogLevelEnabled(level)) return nullptr;
+               curLevel = level;
+               buffer.clear();
+               readTime();
+               appendDate(lastTime);
+               appendLevel(level);
+               appendThreadIdent();
+               std::uint32_t hlen = static_cast<std::uint32_t>(buffer.size());
+               capture.resize(hdrSize + hlen + size);
+               char *p = capture.data();
+               std::memcpy(p, &hlen, hdrSize);
+               p += hdrSize;
+               for (const StrViewA &part: buffer.getParts()) {
+                    std::memcpy(p, part.data, part.length);
+                    p += part.length;
+               }
+               buffer.clear();
+               return p;
+          }
+          virtual void commitCapture() override {
+               StrViewA rec(capture.data(), capture.size());
+               owner->push(&rec, 1, capturedFlag);
+          }
+          virtual PLogProvider newSection(const StrViewA &ident) override {
+               return PLogProvider(new Provider(*this, ident));
+          }
+     protected:
+          StdLogFileAsync *owner;
+          ///buffer for the captured record
+          std::vector<char> capture;
+     };
+
+     std::string pathname;
+     OverflowPolicy policy;
+     std::size_t ringSize;
+     int autorotate_count;
+     ///identifies the log in rings of threads (the address can be reused)
+     const unsigned int instanceId;
+     ///file descriptor - on log rotation, the writer thread replaces the file under the descriptor
+     std::atomic<int> fd = {-1};
+
+     std::mutex ringsmx;
+     std::vector<PRing> rings;
+     std::atomic<unsigned int> ringsVersion = {0};
+
+     std::mutex wrmx;
+     std::condition_variable wrcond;
+     std::atomic<bool> sleeping = {false};
+     std::atomic<bool> stopping = {false};
+     ///producers wait here for free space in the ring (or for flush)
+     std::mutex spacemx;
+     std::condition_variable spacecond;
+     std::atomic<unsigned int> spaceWaiters = {0};
+     std::atomic<std::size_t> dropped = {0};
+     std::atomic<std::size_t> totalDropped = {0};
+     std::thread writer;
+
+     static std::size_t roundSize(std::size_t sz) {
+          std::size_t r = 4096;
+          while (r < sz) r <<= 1;
+          return r;
+     }
+
+     static std::size_t recordSize(std::size_t len) {
+          return (hdrSize + len + 7) & ~static_cast<std::size_t>(7);
+     }
+
+     void openLog() {
+          if (pathname.empty()) {
+               fd = 2;
+          } else {
+               int nfd = ::open(pathname.c_str(), O_WRONLY|O_CREAT|O_APPEND|O_CLOEXEC, 0666);
+               int cur = fd.load();
+               if (cur < 0 || nfd < 0) {
+                    fd = nfd;
+               } else {
+                    //the new file replaces the old one under the same descriptor, so
+                    //a thread which writes directly never writes to a closed descriptor
+                    ::dup2(nfd, cur);
+                    ::fcntl(cur, F_SETFD, FD_CLOEXEC);
+                    ::close(nfd);
+               }
+          }
+     }
+
+     static unsigned int nextInstanceId() {
+          static std::atomic<unsigned int> counter = {0};
+          return counter.fetch_add(1, std::memory_order_relaxed);
+     }
+
+     ///false when rings of the thread are already destroyed (thread is exiting)
+     static bool &threadAlive() {
+          static thread_local bool alive = true;
+          return alive;
+     }
+
+     ///Retrieves ring of the current thread, creates it on first use
+     /**
+      * @return ring, or nullptr, if the thread is exiting and the line must be
+      * written directly
+      */
+     Ring *threadRing() {
+          if (!threadAlive()) return nullptr;
+          static thread_local ThreadRings tr;
+          std::vector<PRing> &trs = tr.rings;
+          for (std::size_t i = 0; i < trs.size(); i++) {
+               Ring *r = trs[i];
+               if (r->ownerId == instanceId) return r;
+               if (r->detached.load(std::memory_order_acquire)) {
+                    trs.erase(trs.begin()+i);
+                    --i;
+               }
+          }
+          PRing r = registerRing();
+          trs.push_back(r);
+          return r;
+     }
+
+     PRing registerRing() {
+          PRing r = new Ring(ringSize, instanceId);
+          std::lock_guard<std::mutex> _(ringsmx);
+          rings.push_back(r);
+          ringsVersion.fetch_add(1, std::memory_order_release);
+          return r;
+     }
+
+     std::vector<PRing> getRings() {
+          std::lock_guard<std::mutex> _(ringsmx);
+          return rings;
+     }
+
+     void wakeWriter() {
+          if (sleeping.load()) {
+               std::lock_guard<std::mutex> _(wrmx);
+               wrcond.notify_one();
+          }
+     }
+
+     ///Waits until the writer thread makes the condition true
+     /** The writer notifies waiting threads every time it advances the tail of a ring.
+      * The condition must read the tail as seq_cst, so either the writer sees
+      * the waiter, or the waiter sees the new tail
+      */
+     template<typename Fn>
+     void waitForWriter(Fn &&cond) {
+          if (cond()) return;
+          spaceWaiters.fetch_add(1);
+          {
+               std::unique_lock<std::mutex> lk(spacemx);
+               while (!cond()) {
+                    wakeWriter();
+                    spacecond.wait(lk);
+               }
+          }
+          spaceWaiters.fetch_sub(1);
+     }
+
+     ///Wakes threads waiting in waitForWriter() (called by writer)
+     void notifySpace() {
+          if (spaceWaiters.load()) {
+               std::lock_guard<std::mutex> _(spacemx);
+               spacecond.notify_all();
+          }
+     }
+
+     ///Writes line directly by the calling thread
+     void writeDirect(const StrViewA *parts, std::size_t count, std::uint32_t flags) {
+          if (flags & capturedFlag) {
+               std::string tmp;
+               formatCaptured(parts[0].data, tmp);
+               StrViewA line(tmp);
+               writeParts(&line, 1);
+          } else {
+               writeParts(parts, count);
+          }
+     }
+
+     ///Push line to the ring of the current thread (called by producer)
+     /**
+      * @param parts parts of the line, or captured record (one part)
+      * @param count count of parts
+      * @param flags capturedFlag for captured record
+      */
+     void push(const StrViewA *parts, std::size_t count, std::uint32_t flags) {
+          Ring *rp = threadRing();
+          if (rp == nullptr) {
+               writeDirect(parts, count, flags);
+               return;
+          }
+          Ring &r = *rp;
+          std::size_t length = 0;
+          for (std::size_t i = 0; i < count; i++) length += parts[i].length;
+          std::size_t rsz = recordSize(length);
+          if (rsz > r.size/2) {
+               //too long for the ring, write it directly once the ring is empty to keep the order
+               std::uint64_t h = r.head.load(std::memory_order_relaxed);
+               waitForWriter([&]{return r.tail.load() == h;});
+               writeDirect(parts, count, flags);
+               return;
+          }
+          std::uint64_t h = r.head.load(std::memory_order_relaxed);
+          std::size_t ofs = static_cast<std::size_t>(h & (r.size-1));
+          std::size_t toEnd = r.size - ofs;
+          std::size_t need = rsz <= toEnd?rsz:toEnd+rsz;
+          auto hasSpace = [&]{return r.size - (h - r.tail.load()) >= need;};
+          if (!hasSpace()) {
+               if (policy == OverflowPolicy::drop) {
+                    dropped.fetch_add(1, std::memory_order_relaxed);
+                    totalDropped.fetch_add(1, std::memory_order_relaxed);
+                    return;
+               }
+               waitForWriter(hasSpace);
+          }
+          char *buff = r.buffer.get();
+          if (rsz > toEnd) {
+               std::uint32_t mark = wrapMark;
+               std::memcpy(buff+ofs, &mark, hdrSize);
+               h += toEnd;
+               ofs = 0;
+          }
+          std::uint32_t len = static_cast<std::uint32_t>(length) | flags;
+          std::memcpy(buff+ofs, &len, hdrSize);
+          char *p = buff+ofs+hdrSize;
+          for (std::size_t i = 0; i < count; i++) {
+               std::memcpy(p, parts[i].data, parts[i].length);
+               p += parts[i].length;
+          }
+          r.head.store(h + rsz);
+          wakeWriter();
+     }
+
+     void writeParts(const StrViewA *parts, std::size_t count) {
+          iovec iov[64];
+          while (count) {
+               int cnt = static_cast<int>(std::min<std::size_t>(count, 64));
+               for (int i = 0; i < cnt; i++) iov[i] = {const_cast<char *>(parts[i].data), parts[i].length};
+               writeAll(iov, cnt);
+               parts += cnt;
+               count -= cnt;
+          }
+     }
+
+     void writeAll(iovec *iov, int cnt) {
+          while (cnt) {
+               ssize_t w = ::writev(fd, iov, cnt);
+               if (w < 0) {
+                    if (errno == EINTR) continue;
+                    return;
+               }
+               std::size_t wr = static_cast<std::size_t>(w);
+               while (cnt && wr >= iov->iov_len) {
+                    wr -= iov->iov_len;
+                    ++iov;
+                    --cnt;
+               }
+               if (cnt) {
+                    iov->iov_base = static_cast<char *>(iov->iov_base) + wr;
+                    iov->iov_len -= wr;
+               }
+          }
+     }
+
+     ///Formats captured record to the line
+     static void formatCaptured(const char *rec, std::string &out) {
+          std::uint32_t hlen;
+          std::memcpy(&hlen, rec, hdrSize);
+          out.append(rec+hdrSize, hlen);
+          logFormatCaptured(rec+hdrSize+hlen, out);
+          out.push_back('\n');
+     }
+
+     ///Writes collected lines
+     /** Formatted lines are stored in the string fmt, which can be reallocated. So
+      * they have iov_base set to nullptr and the pointer is resolved here
+      */
+     void writeBatch(std::vector<iovec> &iov, std::string &fmt) {
+          std::size_t fofs = 0;
+          for (iovec &v: iov) {
+               if (v.iov_base == nullptr) {
+                    v.iov_base = &fmt[fofs];
+                    fofs += v.iov_len;
+               }
+          }
+          writeAll(iov.data(), static_cast<int>(iov.size()));
+          iov.clear();
+          fmt.clear();
+     }
+
+     ///Drains one ring, returns true if something was written
+     bool drain(Ring &r, std::vector<iovec> &iov, std::string &fmt) {
+          std::uint64_t h = r.head.load(std::memory_order_acquire);
+          std::uint64_t t = r.tail.load(std::memory_order_relaxed);
+          if (h == t) return false;
+          const char *buff = r.buffer.get();
+          iov.clear();
+          fmt.clear();
+          while (t != h) {
+               std::size_t ofs = static_cast<std::size_t>(t & (r.size-1));
+               std::uint32_t len;
+               std::memcpy(&len, buff+ofs, hdrSize);
+               if (len == wrapMark) {
+                    t += r.size - ofs;
+                    continue;
+               }
+               if (len & capturedFlag) {
+                    len &= ~capturedFlag;
+                    std::size_t fsz = fmt.size();
+                    formatCaptured(buff+ofs+hdrSize, fmt);
+                    iov.push_back({nullptr, fmt.size() - fsz});
+               } else {
+                    iov.push_back({const_cast<char *>(buff+ofs+hdrSize), len});
+               }
+               t += recordSize(len);
+               if (iov.size() >= IOV_MAX) {
+                    writeBatch(iov, fmt);
+                    r.tail.store(t);
+                    notifySpace();
+               }
+          }
+          if (!iov.empty()) writeBatch(iov, fmt);
+          r.tail.store(t);
+          notifySpace();
+          return true;
+     }
+
+     void worker() {
+          std::vector<PRing> rs;
+          std::vector<iovec> iov;
+          std::string fmt;
+          unsigned int ver = ~0U;
+          for(;;) {
+               bool stop = stopping.load();
+               if (ver != ringsVersion.load(std::memory_order_acquire)) {
+                    std::lock_guard<std::mutex> _(ringsmx);
+                    ver = ringsVersion.load(std::memory_order_relaxed);
+                    rs = rings;
+               }
+               if (!pathname.empty() && AbstractLogProvider::rotated(autorotate_count)) {
+                    openLog();
+               }
+               bool any = false;
+               for (const PRing &r: rs) any = drain(*r, iov, fmt) || any;
+               std::size_t d = dropped.exchange(0, std::memory_order_relaxed);
+               if (d) reportDropped(d);
+               if (!any) {
+                    if (stop) break;
+                    removeClosed();
+                    std::unique_lock<std::mutex> lk(wrmx);
+                    sleeping.store(true);
+                    if (!stopping.load() && !pending(rs) && ver == ringsVersion.load()) {
+                         wrcond.wait_for(lk, std::chrono::milliseconds(100));
+                    }
+                    sleeping.store(false);
+               }
+          }
+     }
+
+     static bool pending(const std::vector<PRing> &rs) {
+          for (const PRing &r: rs) {
+               if (r->head.load() != r->tail.load(std::memory_order_relaxed)) return true;
+          }
+          return false;
+     }
+
+     void removeClosed() {
+          std::lock_guard<std::mutex> _(ringsmx);
+          auto iter = std::remove_if(rings.begin(), rings.end(), [](const PRing &r){
+               return r->closed.load(std::memory_order_acquire)
+                         && r->head.load(std::memory_order_acquire) == r->tail.load(std::memory_order_relaxed);
+          });
+          if (iter != rings.end()) {
+               rings.erase(iter, rings.end());
+               ringsVersion.fetch_add(1, std::memory_order_release);
+          }
+     }
+
+     void reportDropped(std::size_t d) {
+          std::string msg("... ");
+          unsignedToString(d, [&](char c){msg.push_back(c);});
+          msg.append(" log line(s) dropped\n");
+          iovec iov = {const_cast<char *>(msg.data()), msg.size()};
+          writeAll(&iov, 1);
+     }
+};
+
+
+
+}
+
+
+#endif /* _ONDRA_SHARED_STDLOGASYNC_H_8230918230981 */
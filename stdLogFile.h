@@ -5,7 +5,23 @@
 #define _ONDRA_SHARED_STDLOGFILE_H_23312319080809
 
 #include "stdLogOutput.h"
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 namespace ondra_shared {
 
@@ -48,15 +64,19 @@ public:
           outfile.open(pathname, std::ios::app);
      }
 
-     virtual void writeToLog(const StrViewA &line, const std::time_t &, LogLevel) override {
+     virtual void writeToLog(const StrViewA &line, const std::time_t &t, LogLevel level) override {
+          writeToLogParts(&line, 1, t, level);
+     }
+
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &, LogLevel) override {
           if (AbstractLogProvider::rotated(autorotate_count)) {
                outfile << "Log rotated..." <<std::endl;
                reopenLog();
                outfile << "Continues..." <<std::endl;
 
           }
-          outfile << line << std::endl;
-          outfile.flush();
+          for (std::size_t i = 0; i < count; i++) outfile.write(parts[i].data, parts[i].length);
+          outfile << std::endl;
      }
 
 
@@ -92,42 +112,85 @@ protected:
 
 };
 
+///Log file rotated by time or by size
+/**
+ * Rotated files are renamed to pathname.0001, pathname.0002, ... up to rotate_count. The
+ * rotation is performed by a background thread, so writers are not blocked. When the
+ * rotation is needed, writers continue to write to the current file, while the background
+ * thread renames it and opens the new file. Then writers are switched to the new
+ * file. Other rotated files are renamed (and optionally compressed) after the switch.
+ *
+ * The first line of the file contains serial number of the interval. It is used
+ * to detect, whether the file has already been rotated by other process
+ */
 class StdLogFileRotating: public StdLogProviderFactory  {
 public:
 
+     ///Opens the log
+     /**
+      * @param pathname pathname of the log
+      * @param minLevel minimal level
+      * @param rotate_count count of rotated files
+      * @param rotate_interval interval of rotation in seconds. Set 0 to disable time based rotation
+      * @param rotate_size size of the file in bytes, which causes the rotation. Set 0 to disable
+      * size based rotation (default)
+      */
      template<typename Str>
-     StdLogFileRotating(Str &&pathname, LogLevel minLevel = LogLevel::info, unsigned int rotate_count=7, unsigned int rotate_interval = 86400)
+     StdLogFileRotating(Str &&pathname, LogLevel minLevel = LogLevel::info, unsigned int rotate_count=7,
+               unsigned int rotate_interval = 86400, std::uint64_t rotate_size = 0)
           :StdLogProviderFactory ( minLevel)
            ,pathname(std::forward<Str>(pathname))
            ,rotate_count(rotate_count)
            ,rotate_interval(rotate_interval)
+           ,rotate_size(rotate_size)
            {
 
+          std::string staging = stagingName();
+          //finish rotation interrupted by the crash
+          if (fileExists(staging)) finishRotation(staging);
+          unsigned int d = getSerial(std::time(nullptr));
           day_num = readLastDayNumber();
-          if (day_num) {
-               outfile.open(pathname, std::ios::app);
+          if (day_num != d && fileExists(this->pathname)) doRotate();
+          outfile = openFile(d, cur_size);
+          day_num = d;
+     }
+
+     ~StdLogFileRotating() {
+          {
+               std::lock_guard<std::mutex> _(workerLock);
+               stopWorker = true;
           }
+          workerCond.notify_all();
+          if (worker.joinable()) worker.join();
+     }
+
+     ///Enables compression of rotated files
+     /**
+      * @param command command which compresses the file. The file name is appended as
+      * the argument. The command is executed by the background thread. It is split to
+      * arguments by whitespaces, it is not executed by the shell
+      * @param suffix suffix of the compressed file (for example: setCompression("gzip -f",".gz"))
+      */
+     void setCompression(StrViewA command, StrViewA suffix) {
+          std::lock_guard<std::mutex> _(workerLock);
+          compress_command = command;
+          compress_suffix = suffix;
      }
 
      static void renameFile(const char* src, const char* trg) {
-#if _WIN32
+#ifdef _WIN32
           MoveFileExA(src, trg, MOVEFILE_REPLACE_EXISTING);
 #else
           std::rename(src, trg);
 #endif
      }
 
+     ///Renames the log file to pathname.0001, older files are shifted
      void doRotate() {
-          std::string n1;
-          std::string n2;
-          appendNumber(n2, rotate_count);
-          for (int i = rotate_count; i > 1; i--) {
-               std::swap(n2,n1);
-               appendNumber(n2,i-1);
-               renameFile(n2.c_str(),n1.c_str());
-          }
-          renameFile(pathname.c_str(),n2.c_str());
-
+          shiftFiles();
+          std::string n;
+          appendNumber(n, 1);
+          renameFile(pathname.c_str(), n.c_str());
      }
 
      void appendNumber(std::string &buff, int number) {
@@ -148,39 +211,228 @@ public:
           return std::strtoul(nr,nullptr, 10);
      }
 
-     virtual void writeToLog(const StrViewA &line, const std::time_t &t, LogLevel) override {
-          unsigned int d = static_cast<unsigned int>(t/rotate_interval);
-          if (d != day_num) {
-               outfile.close();
-               day_num = readLastDayNumber();
-               if (day_num != d) doRotate();
-               outfile.open(pathname,std::ios::app);
-               outfile << "Rotation serial nr.: " << d << std::endl;
+     virtual void writeToLog(const StrViewA &line, const std::time_t &t, LogLevel level) override {
+          writeToLogParts(&line, 1, t, level);
+     }
+
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &t, LogLevel) override {
+          if (!rotating) {
+               unsigned int d = getSerial(t);
+               if (d != day_num) requestRotate(d, false);
+               else if (rotate_size && cur_size >= rotate_size) requestRotate(d, true);
           }
-          outfile << line << std::endl;
-          outfile.flush();
+          std::ofstream &f = *outfile;
+          std::size_t len = 1;
+          for (std::size_t i = 0; i < count; i++) {
+               f.write(parts[i].data, parts[i].length);
+               len += parts[i].length;
+          }
+          f << std::endl;
+          cur_size += len;
      }
 
 
-     static PStdLogProviderFactory create(StrViewA pathname, LogLevel minLevel, unsigned int rotate_count = 7, unsigned int rotate_interval = 86400) {
+     static PStdLogProviderFactory create(StrViewA pathname, LogLevel minLevel, unsigned int rotate_count = 7,
+               unsigned int rotate_interval = 86400, std::uint64_t rotate_size = 0) {
           if (pathname.empty()) return new StdLogProviderFactory(minLevel);
-          else return new StdLogFileRotating(pathname, minLevel, rotate_count, rotate_interval);
+          else return new StdLogFileRotating(pathname, minLevel, rotate_count, rotate_interval, rotate_size);
      }
 
-     static PStdLogProviderFactory create(StrViewA pathname, StrViewA level, LogLevel defaultLevel, unsigned int rotate_count = 7, unsigned int rotate_interval = 86400) {
+     static PStdLogProviderFactory create(StrViewA pathname, StrViewA level, LogLevel defaultLevel, unsigned int rotate_count = 7,
+               unsigned int rotate_interval = 86400, std::uint64_t rotate_size = 0) {
           LogLevelToStrTable lstr;
           auto l = lstr.fromString(level,defaultLevel);
-          return create(pathname, l, rotate_count, rotate_interval);
+          return create(pathname, l, rotate_count, rotate_interval, rotate_size);
      }
 
 protected:
+     using PFile = std::unique_ptr<std::ofstream>;
+
      std::string pathname;
-     std::ofstream outfile;
+     ///current file (guarded by the lock)
+     PFile outfile;
      unsigned int rotate_count;
      unsigned int day_num;
      unsigned int rotate_interval;
-};
+     std::uint64_t rotate_size;
+     ///size of the current file (guarded by the lock)
+     std::uint64_t cur_size = 0;
+     ///rotation has been requested and it is not finished yet (guarded by the lock)
+     bool rotating = false;
+
+     std::thread worker;
+     std::mutex workerLock;
+     std::condition_variable workerCond;
+     ///following members are guarded by the workerLock
+     bool stopWorker = false;
+     bool rotateRequest = false;
+     bool rotateBySize = false;
+     unsigned int rotateSerial = 0;
+     std::string compress_command;
+     std::string compress_suffix;
+
+     unsigned int getSerial(std::time_t t) const {
+          return rotate_interval?static_cast<unsigned int>(t/rotate_interval):0;
+     }
+
+     std::string stagingName() const {
+          return pathname + ".rotating";
+     }
+
+     static bool fileExists(const std::string &name) {
+          return !!std::ifstream(name, std::ios::in);
+     }
+
+     ///Opens the log file, writes the serial number to the new file
+     /**
+      * @param d serial number of the interval
+      * @param size receives size of the file
+      */
+     PFile openFile(unsigned int d, std::uint64_t &size) {
+          PFile f(new std::ofstream(pathname, std::ios::app));
+          f->seekp(0, std::ios::end);
+          std::streamoff sz = f->tellp();
+          if (sz <= 0) {
+               *f << "Rotation serial nr.: " << d << std::endl;
+               sz = f->tellp();
+          }
+          size = sz > 0?static_cast<std::uint64_t>(sz):0;
+          return f;
+     }
 
+     ///Called by the writer (under the lock) - wakes the background thread
+     void requestRotate(unsigned int d, bool bySize) {
+          rotating = true;
+          std::lock_guard<std::mutex> _(workerLock);
+          rotateRequest = true;
+          rotateBySize = bySize;
+          rotateSerial = d;
+          if (!worker.joinable()) worker = std::thread([this]{workerProc();});
+          workerCond.notify_all();
+     }
+
+     void workerProc() {
+          std::unique_lock<std::mutex> wl(workerLock);
+          for(;;) {
+               workerCond.wait(wl, [&]{return stopWorker || rotateRequest;});
+               if (rotateRequest) {
+                    rotateRequest = false;
+                    bool bySize = rotateBySize;
+                    unsigned int d = rotateSerial;
+                    wl.unlock();
+                    rotate(d, bySize);
+                    wl.lock();
+               } else {
+                    break;
+               }
+          }
+     }
+
+     ///Performs the rotation in the background thread
+     void rotate(unsigned int d, bool bySize) {
+          std::string staging = stagingName();
+          //other process could already rotate the file
+          bool rename = bySize || readLastDayNumber() != d;
+#ifdef _WIN32
+          //opened file cannot be renamed, so writers must wait
+          {
+               std::lock_guard<std::recursive_mutex> _(lock);
+               outfile->close();
+               if (rename) renameFile(pathname.c_str(), staging.c_str());
+               outfile = openFile(d, cur_size);
+               day_num = d;
+               rotating = false;
+          }
+#else
+          if (rename) renameFile(pathname.c_str(), staging.c_str());
+          std::uint64_t size;
+          PFile f = openFile(d, size);
+          {
+               std::lock_guard<std::recursive_mutex> _(lock);
+               std::swap(f, outfile);
+               cur_size = size;
+               day_num = d;
+               rotating = false;
+          }
+          //old file is closed outside of the lock
+          f.reset();
+#endif
+          if (rename) finishRotation(staging);
+     }
+
+     ///Shifts rotated files, moves the staging file to the first position and compresses it
+     void finishRotation(const std::string &staging) {
+          shiftFiles();
+          std::string n;
+          appendNumber(n, 1);
+          renameFile(staging.c_str(), n.c_str());
+          std::string cmd, suffix;
+          {
+               std::lock_guard<std::mutex> _(workerLock);
+               cmd = compress_command;
+               suffix = compress_suffix;
+          }
+          if (!cmd.empty()) {
+               //if the command fails, the file stays uncompressed
+               runCommand(cmd, n);
+          }
+     }
+
+     ///Runs the command with the file as the last argument, waits for its exit
+     /**
+      * The command is split to arguments by whitespaces, the shell is not used, so
+      * the name of the file is never interpreted
+      *
+      * @retval true command finished successfully
+      * @retval false failed to execute or command failed
+      */
+     static bool runCommand(const std::string &cmd, const std::string &file) {
+          std::vector<std::string> args;
+          std::size_t pos = 0;
+          while (pos < cmd.size()) {
+               std::size_t b = cmd.find_first_not_of(" \t", pos);
+               if (b == cmd.npos) break;
+               std::size_t e = cmd.find_first_of(" \t", b);
+               if (e == cmd.npos) e = cmd.size();
+               args.push_back(cmd.substr(b, e-b));
+               pos = e;
+          }
+          if (args.empty()) return false;
+          args.push_back(file);
+          std::vector<char *> argv;
+          for (std::string &a: args) argv.push_back(&a[0]);
+          argv.push_back(nullptr);
+#ifdef _WIN32
+          return _spawnvp(_P_WAIT, argv[0], argv.data()) == 0;
+#else
+          pid_t pid;
+          if (posix_spawnp(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return false;
+          int status;
+          while (waitpid(pid, &status, 0) < 0) {
+               if (errno != EINTR) return false;
+          }
+          return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+     }
+
+     ///Shifts rotated files - the last one is removed
+     void shiftFiles() {
+          std::string suffix;
+          {
+               std::lock_guard<std::mutex> _(workerLock);
+               suffix = compress_suffix;
+          }
+          std::string n1;
+          std::string n2;
+          appendNumber(n2, rotate_count);
+          for (int i = rotate_count; i > 1; i--) {
+               std::swap(n2,n1);
+               appendNumber(n2,i-1);
+               renameFile(n2.c_str(),n1.c_str());
+               if (!suffix.empty()) renameFile((n2+suffix).c_str(),(n1+suffix).c_str());
+          }
+     }
+};
 
 
 
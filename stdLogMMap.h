@@ -0,0 +1,285 @@
+/*
+ * stdLogMMap.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef _ONDRA_SHARED_STDLOGMMAP_H_90283409128347
+#define _ONDRA_SHARED_STDLOGMMAP_H_90283409128347
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "stdLogOutput.h"
+
+namespace ondra_shared {
+
+///Log to a memory mapped file
+/**
+ * Lines are copied directly to the file mapped to the memory. Every line reserves its space
+ * by an atomic bump pointer shared by all threads, so threads don't wait for each other.
+ * The file is extended and mapped by segments (64MB by default).
+ *
+ * Written lines are in the page cache immediately, so they survive crash of the process
+ * (not crash of the system, see sync()). The function writeLine() can be used
+ * with CrashHandler to write the backtrace to the same file.
+ *
+ * While the log is open, the file contains zeroes after the last line. They are
+ * removed when the log is closed. If the process crashes, zeroes stays in the file
+ * and they are overwritten when the log is opened next time. A line which was being
+ * written during the crash can contain zeroes too.
+ *
+ * @note log rotation is not supported
+ * @note available on POSIX platforms
+ */
+class StdLogFileMMap: public StdLogProviderFactory {
+public:
+
+     ///Open the log
+     /**
+      * @param pathname pathname of the log file
+      * @param minLevel minimum allowed log level
+      * @param segmentSize size of the step, by which the file is extended. It is rounded
+      * up to whole MB
+      */
+     StdLogFileMMap(StrViewA pathname,
+               LogLevel minLevel = LogLevel::info,
+               std::size_t segmentSize = 64*1024*1024)
+          :StdLogProviderFactory(minLevel)
+          ,pathname(pathname)
+          ,segmentSize(roundSize(segmentSize))
+          ,segments(new std::atomic<char *>[maxSegments]())
+     {
+          fd = ::open(this->pathname.c_str(), O_RDWR|O_CREAT|O_CLOEXEC, 0666);
+          if (fd >= 0) {
+               struct stat st;
+               if (::fstat(fd, &st) == 0) fileSize = static_cast<std::uint64_t>(st.st_size);
+               pos = findEnd();
+          }
+     }
+
+     ~StdLogFileMMap() {
+          for (std::size_t i = 0; i < maxSegments; i++) {
+               char *s = segments[i].load(std::memory_order_relaxed);
+               if (s) ::munmap(s, segmentSize);
+          }
+          if (fd >= 0) {
+               //remove unused part of the last segment
+               if (::ftruncate(fd, static_cast<off_t>(pos.load())) != 0) {/*ignore*/}
+               ::close(fd);
+          }
+     }
+
+     bool operator! () const {
+          return fd < 0;
+     }
+
+     operator bool() const {
+          return fd >= 0;
+     }
+
+     void setCurrent() {
+          AbstractLogProviderFactory::getInstance() = this;
+          AbstractLogProvider::getInstance() = create();
+     }
+
+     virtual PLogProvider create() override {
+          return PLogProvider(new Provider(this));
+     }
+
+     virtual void writeToLog(const StrViewA &line, const std::time_t &, LogLevel ) override {
+          StrViewA parts[2] = {line, "\n"};
+          append(parts, 2, true);
+     }
+
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &, LogLevel ) override {
+          StrViewA nl("\n");
+          append(parts, count, true, &nl);
+     }
+
+     ///Writes line to the log
+     /**
+      * The function doesn't lock and doesn't allocate memory. It doesn't extend the
+      * file, but there is always one segment mapped ahead. It is intended to be
+      * called from a signal handler
+      *
+      * @code
+      * CrashHandler crash([&](const char *line){mlog->writeLine(line);});
+      * crash.install();
+      * @endcode
+      *
+      * @param line text of the line (without new line)
+      */
+     void writeLine(const char *line) {
+          StrViewA parts[2] = {StrViewA(line, std::strlen(line)), "\n"};
+          append(parts, 2, false);
+     }
+
+     ///Schedules writing of the mapped data to the disk
+     /**
+      * The data are written by the system later. Call this function if you need to
+      * preserve the log in case of the system crash
+      */
+     void sync() {
+          for (std::size_t i = 0; i < maxSegments; i++) {
+               char *s = segments[i].load(std::memory_order_acquire);
+               if (s) ::msync(s, segmentSize, MS_ASYNC);
+          }
+     }
+
+     ///Returns count of bytes, which were not written
+     /** This happens, when the file cannot be extended (disk is full) or mapped */
+     std::size_t getDropped() const {
+          return dropped.load(std::memory_order_relaxed);
+     }
+
+     ///Create log to memory mapped file
+     /**
+      * @param pathname pathname to file, if empty, stderr is used
+      * @param minLevel minimal level
+      * @return log provider
+      */
+     static PStdLogProviderFactory create(StrViewA pathname, LogLevel minLevel) {
+          if (pathname.empty()) return new StdLogProviderFactory(minLevel);
+          else return new StdLogFileMMap(pathname, minLevel);
+     }
+
+protected:
+
+     ///Provider writes lines directly, without the lock of the factory
+     class Provider: public StdLogProvider {
+     public:
+          Provider(StdLogFileMMap *owner)
+               :StdLogProvider(owner),owner(owner) {}
+          Provider(const Provider &other, StrViewA ident)
+               :StdLogProvider(other, ident),owner(other.owner) {}
+
+          virtual void commit(const MutableStrViewA &text) override {
+               finishBuffer(text);
+               buffer.push_back('\n');
+               const std::vector<StrViewA> &parts = buffer.getParts();
+               owner->append(parts.data(), parts.size(), true);
+               buffer.clear();
+          }
+          virtual PLogProvider newSection(const StrViewA &ident) override {
+               return PLogProvider(new Provider(*this, ident));
+          }
+     protected:
+          StdLogFileMMap *owner;
+     };
+
+     static constexpr std::size_t maxSegments = 16384;
+
+     std::string pathname;
+     std::size_t segmentSize;
+     std::unique_ptr<std::atomic<char *>[]> segments;
+     int fd = -1;
+     ///current size of the file (guarded by mapLock)
+     std::uint64_t fileSize = 0;
+     ///bump pointer - offset of the next line
+     std::atomic<std::uint64_t> pos = {0};
+     std::atomic<std::size_t> dropped = {0};
+     std::mutex mapLock;
+
+     static std::size_t roundSize(std::size_t sz) {
+          const std::size_t mb = 1024*1024;
+          return std::max<std::size_t>((sz + mb - 1) / mb, 1) * mb;
+     }
+
+     ///Finds end of the data in existing file - skips zeroes at the end
+     std::uint64_t findEnd() {
+          char buff[65536];
+          std::uint64_t end = fileSize;
+          while (end) {
+               std::size_t sz = static_cast<std::size_t>(std::min<std::uint64_t>(end, sizeof(buff)));
+               if (::pread(fd, buff, sz, static_cast<off_t>(end - sz)) != static_cast<ssize_t>(sz)) break;
+               const char *p = buff + sz;
+               while (p != buff && p[-1] == 0) --p;
+               if (p != buff) return end - sz + (p - buff);
+               end -= sz;
+          }
+          return end;
+     }
+
+     ///Maps the segment, extends the file if needed
+     /** The space of the segment is allocated on the disk. A sparse file would raise
+      * SIGBUS when the disk is full. If the space cannot be allocated, the segment is
+      * not mapped and lines written to it are counted as dropped
+      */
+     char *mapSegment(std::size_t idx) {
+          if (idx >= maxSegments || fd < 0) return nullptr;
+          std::lock_guard<std::mutex> _(mapLock);
+          char *s = segments[idx].load(std::memory_order_acquire);
+          if (s) return s;
+          std::uint64_t need = static_cast<std::uint64_t>(idx + 1) * segmentSize;
+          //allocate whole segment, the existing part of the file can contain holes too
+          if (::posix_fallocate(fd, static_cast<off_t>(need - segmentSize),
+                    static_cast<off_t>(segmentSize)) != 0) return nullptr;
+          if (fileSize < need) fileSize = need;
+          void *m = ::mmap(nullptr, segmentSize, PROT_READ|PROT_WRITE, MAP_SHARED, fd,
+                         static_cast<off_t>(static_cast<std::uint64_t>(idx) * segmentSize));
+          if (m == MAP_FAILED) return nullptr;
+          s = static_cast<char *>(m);
+          segments[idx].store(s, std::memory_order_release);
+          return s;
+     }
+
+     char *getSegment(std::size_t idx, bool canMap) {
+          if (idx >= maxSegments) return nullptr;
+          char *s = segments[idx].load(std::memory_order_acquire);
+          if (s == nullptr && canMap) {
+               s = mapSegment(idx);
+               //keep one segment ahead, so writeLine() can continue
+               mapSegment(idx+1);
+          }
+          return s;
+     }
+
+     void copyTo(std::uint64_t offset, const char *data, std::size_t len, bool canMap) {
+          while (len) {
+               std::size_t idx = static_cast<std::size_t>(offset / segmentSize);
+               std::size_t ofs = static_cast<std::size_t>(offset % segmentSize);
+               std::size_t sz = std::min(len, segmentSize - ofs);
+               char *s = getSegment(idx, canMap);
+               if (s) std::memcpy(s+ofs, data, sz);
+               else dropped.fetch_add(sz, std::memory_order_relaxed);
+               offset += sz;
+               data += sz;
+               len -= sz;
+          }
+     }
+
+     ///Appends the line
+     /**
+      * @param parts parts of the line
+      * @param count count of parts
+      * @param canMap true if the function can map new segment
+      * @param extra optional part appended after parts
+      */
+     void append(const StrViewA *parts, std::size_t count, bool canMap, const StrViewA *extra = nullptr) {
+          std::size_t total = extra?extra->length:0;
+          for (std::size_t i = 0; i < count; i++) total += parts[i].length;
+          std::uint64_t offset = pos.fetch_add(total, std::memory_order_relaxed);
+          for (std::size_t i = 0; i < count; i++) {
+               copyTo(offset, parts[i].data, parts[i].length, canMap);
+               offset += parts[i].length;
+          }
+          if (extra) copyTo(offset, extra->data, extra->length, canMap);
+     }
+};
+
+
+
+}
+
+
+#endif /* _ONDRA_SHARED_STDLOGMMAP_H_90283409128347 */
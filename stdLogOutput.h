@@ -4,9 +4,14 @@
 #ifndef _ONDRA_SHARED_STDLOGOUTPUT_H_23312319080809
 #define _ONDRA_SHARED_STDLOGOUTPUT_H_23312319080809
 
+#include <atomic>
+#include <chrono>
 #include <ctime>
 #include <cstddef>
+#include <memory>
 #include <mutex>
+#include <string>
+#include <vector>
 #include "logOutput.h"
 #include "refcnt.h"
 
@@ -25,31 +30,140 @@ public:
           std::cerr << line << std::endl;
      }
 
+     ///Writes line composed from parts
+     /**
+      * @param parts parts of the line
+      * @param count count of parts
+      *
+      * Default implementation joins parts and calls writeToLog(). Override this
+      * function to write parts without copying
+      */
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &time, LogLevel level) {
+          if (count == 1) {
+               writeToLog(parts[0], time, level);
+          } else {
+               std::string line;
+               for (std::size_t i = 0; i < count; i++) line.append(parts[i].data, parts[i].length);
+               writeToLog(line, time, level);
+          }
+     }
+
      void sendToLog(const StrViewA &line, const std::time_t &time, LogLevel level) {
           std::lock_guard<std::recursive_mutex> _(lock);
           writeToLog(line, time, level);
      }
 
+     void sendToLog(const StrViewA *parts, std::size_t count, const std::time_t &time, LogLevel level) {
+          std::lock_guard<std::recursive_mutex> _(lock);
+          writeToLogParts(parts, count, time, level);
+     }
+
 
      void setEnabledLogLevel(LogLevel lev) {
-          enabledLevel = lev;
+          enabledLevel.store(lev, std::memory_order_relaxed);
+          LogLevelCache::invalidate();
      }
 
      virtual bool isLogLevelEnabled(LogLevel lev) const override {
-          return lev >= enabledLevel;
+          return lev >= enabledLevel.load(std::memory_order_relaxed);
      }
 
+     ///Enables milliseconds in the timestamp
+     /**
+      * @param enable true to write time with milliseconds. The time is read
+      * from the coarse clock (if available), so its resolution is given by
+      * the system tick (usually 1-4 ms)
+      */
+     void setSubsecondPrecision(bool enable) {
+          subsecond = enable;
+     }
 
+     bool isSubsecondPrecision() const {
+          return subsecond;
+     }
 
 
 protected:
      std::recursive_mutex lock;
-     LogLevel enabledLevel;
+     std::atomic<LogLevel> enabledLevel;
+     bool subsecond = false;
 
 };
 
 using PStdLogProviderFactory = RefCntPtr<StdLogProviderFactory>;
 
+namespace _logDetails {
+
+     ///Buffer for the log line composed from chunks
+     /**
+      * Chunks are not initialized and they are kept for next lines, so the buffer
+      * is never reallocated nor shrunk. The line is available as list of parts
+      */
+     class LogLineBuffer {
+     public:
+          static constexpr std::size_t chunkSize = 4096;
+
+          ///Starts new line
+          void clear() {
+               cur = 0;
+               pos = 0;
+          }
+
+          void append(const char *text, std::size_t len) {
+               while (len) {
+                    MutableStrViewA w = window();
+                    std::size_t sz = std::min(len, w.length);
+                    std::copy(text, text+sz, w.data);
+                    commitWindow(w.data+sz);
+                    text += sz;
+                    len -= sz;
+               }
+          }
+
+          void push_back(char c) {
+               append(&c, 1);
+          }
+
+          ///Returns free space of the current chunk
+          MutableStrViewA window() {
+               if (cur == chunks.size()) chunks.emplace_back(new char[chunkSize]);
+               return MutableStrViewA(chunks[cur].get()+pos, chunkSize-pos);
+          }
+
+          ///Marks space of the window as used
+          /**
+           * @param end pointer after the last used character. It must be in the window
+           */
+          void commitWindow(const char *end) {
+               pos = end - chunks[cur].get();
+               if (pos == chunkSize) {
+                    ++cur;
+                    pos = 0;
+               }
+          }
+
+          ///Returns parts of the line
+          const std::vector<StrViewA> &getParts() {
+               parts.clear();
+               for (std::size_t i = 0; i < cur; i++) parts.push_back(StrViewA(chunks[i].get(), chunkSize));
+               if (pos || cur == 0) parts.push_back(StrViewA(cur < chunks.size()?chunks[cur].get():"", pos));
+               return parts;
+          }
+
+          ///Returns size of the line
+          std::size_t size() const {
+               return cur * chunkSize + pos;
+          }
+
+     protected:
+          std::vector<std::unique_ptr<char[]> > chunks;
+          std::vector<StrViewA> parts;
+          std::size_t cur = 0;
+          std::size_t pos = 0;
+     };
+
+}
+
 
 class StdLogProvider: public AbstractLogProvider {
 public:
@@ -68,15 +182,34 @@ public:
      virtual void setProgress(float progressVal, int expectedCycles)  override;
 
 
+     ///Tests the level against copy of the level of the factory
+     /** The copy is refreshed when the LogLevelCache is invalidated */
      virtual bool isLogLevelEnabled(LogLevel level) const  override{
-          return shared->isLogLevelEnabled(level);
+          unsigned int e = LogLevelCache::getEpoch();
+          if (e != levelEpoch) {
+               minLevel = LogLevelCache::lowestLevel(static_cast<const StdLogProviderFactory *>(shared));
+               levelEpoch = e;
+          }
+          return level >= minLevel;
      }
 protected:
-     std::vector<char> buffer;
+     ///buffer of the current line
+     /** It is written directly by LogWriterFn through the window of the current chunk */
+     _logDetails::LogLineBuffer buffer;
      std::string ident;
      PFactory shared;
      time_t lastTime;
+     ///nanoseconds of the lastTime
+     unsigned int lastTimeNs = 0;
      LogLevel curLevel;
+     ///pre-rendered "[thread][ident] "
+     std::string header;
+     ///thread for which the header was rendered
+     unsigned int headerThread = 0;
+     ///epoch of LogLevelCache, when the minLevel was read
+     mutable unsigned int levelEpoch = 0;
+     ///lowest level enabled by the factory
+     mutable LogLevel minLevel = LogLevel::off;
 
 
      void finishBuffer(const MutableStrViewA &b);
@@ -86,8 +219,66 @@ protected:
      virtual void appendDate(std::time_t now);
      virtual void appendLevel(LogLevel level);
      virtual void appendThreadIdent();
+
+     void append(const char *text, std::size_t len) {
+          buffer.append(text, len);
+     }
+     ///Reads current time to the lastTime and lastTimeNs
+     void readTime();
 };
 
+namespace _logDetails {
+
+     ///Returns text of the level as it appears in the log (6 characters including the space)
+     inline const char *logLevelText(LogLevel level) {
+          static const char levels[][7] = {
+                    "debug ", "info  ", "      ", "Note  ", "Warn. ", "Error ", "FATAL "
+          };
+          unsigned int idx = static_cast<unsigned int>(level);
+          //progress is used for unknown levels
+          if (idx > static_cast<unsigned int>(LogLevel::fatal)) idx = static_cast<unsigned int>(LogLevel::progress);
+          return levels[idx];
+     }
+
+     ///Formatted date of one second, cached per thread
+     struct LogDateCache {
+          std::time_t time = -1;
+          ///"YYYY-MM-DD HH:MM:SS"
+          char text[19];
+
+          static LogDateCache &instance() {
+               static thread_local LogDateCache cache;
+               return cache;
+          }
+
+          const char *get(std::time_t now) {
+               if (now != time) {
+                    std::tm tinfo;
+#ifdef _WIN32
+                    gmtime_s(&tinfo, &now);
+#else
+                    gmtime_r(&now, &tinfo);
+#endif
+                    char *p = text;
+                    p = unsignedToBuffer(tinfo.tm_year+1900, p, 10, 4);
+                    *p++ = '-';
+                    p = unsignedToBuffer(tinfo.tm_mon+1, p, 10, 2);
+                    *p++ = '-';
+                    p = unsignedToBuffer(tinfo.tm_mday, p, 10, 2);
+                    *p++ = ' ';
+                    p = unsignedToBuffer(tinfo.tm_hour, p, 10, 2);
+                    *p++ = ':';
+                    p = unsignedToBuffer(tinfo.tm_min, p, 10, 2);
+                    *p++ = ':';
+                    unsignedToBuffer(tinfo.tm_sec, p, 10, 2);
+                    time = now;
+               }
+               return text;
+          }
+     };
+
+}
+
 inline PLogProvider StdLogProviderFactory::create() {
      return PLogProvider(new StdLogProvider(this));
 }
@@ -106,72 +297,60 @@ inline unsigned int StdLogProvider::getThreadIdent() {
      return curThreadId;
 }
 
-inline void StdLogProvider::appendDate(std::time_t now) {
-
-     auto wrfn = [&](char c) { buffer.push_back(c);};
-
-     std::tm tinfo;
-#ifdef _WIN32
-     gmtime_s(&tinfo, &now);
+inline void StdLogProvider::readTime() {
+#ifdef CLOCK_REALTIME_COARSE
+     timespec ts;
+     clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+     lastTime = ts.tv_sec;
+     lastTimeNs = static_cast<unsigned int>(ts.tv_nsec);
 #else
-     gmtime_r(&now, &tinfo);
+     auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::system_clock::now().time_since_epoch()).count();
+     lastTime = static_cast<std::time_t>(ns / 1000000000);
+     lastTimeNs = static_cast<unsigned int>(ns % 1000000000);
 #endif
-
-     unsignedToString(tinfo.tm_year+1900, wrfn, 10,4);
-     buffer.push_back('-');
-     unsignedToString(tinfo.tm_mon+1, wrfn, 10,2);
-     buffer.push_back('-');
-     unsignedToString(tinfo.tm_mday, wrfn, 10,2);
-     buffer.push_back(' ');
-     unsignedToString(tinfo.tm_hour, wrfn, 10,2);
-     buffer.push_back(':');
-     unsignedToString(tinfo.tm_min, wrfn, 10,2);
-     buffer.push_back(':');
-     unsignedToString(tinfo.tm_sec, wrfn, 10,2);
-     buffer.push_back(' ');
 }
 
-inline void StdLogProvider::appendLevel(LogLevel level) {
-     auto wrstr = [&](StrViewA c) { for (char x:c) buffer.push_back(x);};
-
-     switch (level) {
-     case LogLevel::fatal: wrstr("FATAL");break;
-     case LogLevel::error: wrstr("Error");break;
-     case LogLevel::warning: wrstr("Warn.");break;
-     case LogLevel::note: wrstr("Note ");break;
-     case LogLevel::info: wrstr("info ");break;
-     case LogLevel::debug: wrstr("debug");break;
-     default:
-     case LogLevel::progress: wrstr("     ");break;
+inline void StdLogProvider::appendDate(std::time_t now) {
+     append(_logDetails::LogDateCache::instance().get(now), 19);
+     if (shared->isSubsecondPrecision()) {
+          char ms[5];
+          ms[0] = '.';
+          unsignedToBuffer(lastTimeNs / 1000000, ms+1, 10, 3);
+          append(ms, 4);
      }
      buffer.push_back(' ');
+}
 
+inline void StdLogProvider::appendLevel(LogLevel level) {
+     append(_logDetails::logLevelText(level), 6);
 }
 
 inline void StdLogProvider::appendThreadIdent() {
      auto curThreadId = getThreadIdent();
-     auto wrstr = [&](StrViewA c) { for (char x:c) buffer.push_back(x);};
-     auto wrfn = [&](char c) { buffer.push_back(c);};
-
-     buffer.push_back('[');
-     unsignedToString(curThreadId, wrfn, 10,4);
-     wrstr(ident);
-     wrstr("] ");
-
+     if (curThreadId != headerThread || header.empty()) {
+          char buff[numberBufferSize<unsigned int>()];
+          header.clear();
+          header.push_back('[');
+          header.append(buff, unsignedToBuffer(curThreadId, buff, 10, 4) - buff);
+          header.append(ident);
+          header.append("] ");
+          headerThread = curThreadId;
+     }
+     append(header.data(), header.size());
 }
 
 inline bool StdLogProvider::start(LogLevel level, MutableStrViewA& b) {
 
-     if (shared->isLogLevelEnabled(level)) {
+     if (StdLogProvider::isLogLevelEnabled(level)) {
           curLevel = level;
           buffer.clear();
-          std::time(&lastTime);
+          readTime();
 
           appendDate(lastTime);
           appendLevel(level);
           appendThreadIdent();
-          b = MutableStrViewA(buffer.data(), buffer.size());
-          prepareBuffer(b);
+          b = buffer.window();
           return true;
      } else {
           return false;
@@ -184,21 +363,19 @@ inline void StdLogProvider::sendBuffer(MutableStrViewA& text) {
 
 inline void StdLogProvider::commit(const MutableStrViewA& text) {
      finishBuffer(text);
-     shared->sendToLog(StrViewA(buffer.data(), buffer.size()), lastTime, curLevel);
+     const std::vector<StrViewA> &parts = buffer.getParts();
+     shared->sendToLog(parts.data(), parts.size(), lastTime, curLevel);
      buffer.clear();
 }
 
 
 inline void StdLogProvider::finishBuffer(const MutableStrViewA& b) {
-     auto offset = b.data - buffer.data();
-     buffer.resize(b.length+offset);
+     buffer.commitWindow(b.data+b.length);
 }
 
 inline void StdLogProvider::prepareBuffer(MutableStrViewA& b) {
      finishBuffer(b);
-     auto offset = buffer.size();
-     buffer.resize(offset*3/2+400);
-     b = MutableStrViewA(buffer.data()+offset, buffer.size()-offset);
+     b = buffer.window();
 }
 
 }
@@ -0,0 +1,247 @@
+/*
+ * stringsearch.h
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef ONDRA_SHARED_STRINGSEARCH_H_28937461029384
+#define ONDRA_SHARED_STRINGSEARCH_H_28937461029384
+
+#include <cstddef>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define ONDRA_SHARED_STRINGSEARCH_X86 1
+#include <immintrin.h>
+#endif
+
+namespace ondra_shared {
+
+namespace _details {
+
+///Search of byte strings
+/**
+ * Uses SIMD filter of the first and the last byte of the needle. Only candidates
+ * which match both bytes are compared. The implementation (AVX2, SSE2 or scalar) is
+ * selected at runtime according to the CPU.
+ */
+class StringSearch {
+public:
+
+     ///Finds non-overlapping occurrences of the needle
+     /**
+      * @param b begin of haystack
+      * @param e end of haystack
+      * @param n needle
+      * @param nlen length of the needle (must not be zero)
+      * @param out array which receives pointers to the occurrences
+      * @param cap capacity of the array
+      * @return count of occurrences found. If it is equal to cap, the search can
+      * continue from the last occurrence + nlen
+      */
+     using FindAllFn = std::size_t (*)(const char *b, const char *e, const char *n, std::size_t nlen,
+                                        const char **out, std::size_t cap);
+     ///Finds last occurrence of the needle
+     /**
+      * @param b begin of haystack
+      * @param e end of haystack
+      * @param n needle
+      * @param nlen length of the needle (must not be zero)
+      * @return pointer to the occurrence or nullptr
+      */
+     using FindLastFn = const char *(*)(const char *b, const char *e, const char *n, std::size_t nlen);
+
+     struct Impl {
+          FindAllFn findAll;
+          FindLastFn findLast;
+     };
+
+     ///Retrieves implementation selected for current CPU
+     /** The implementation can be replaced, tests use it to force each of them */
+     static Impl &impl() {
+          static Impl i = select();
+          return i;
+     }
+
+     ///Finds first occurrence
+     static const char *find(const char *b, const char *e, const char *n, std::size_t nlen) {
+          const char *r;
+          return impl().findAll(b, e, n, nlen, &r, 1)?r:nullptr;
+     }
+
+     ///Finds last occurrence
+     static const char *findLast(const char *b, const char *e, const char *n, std::size_t nlen) {
+          return impl().findLast(b, e, n, nlen);
+     }
+
+     ///Calls function for each non-overlapping occurrence
+     /**
+      * @param fn function receives pointer to the occurrence. It returns true to continue,
+      * or false to stop
+      */
+     template<typename Fn>
+     static void forEach(const char *b, const char *e, const char *n, std::size_t nlen, Fn &&fn) {
+          const char *found[64];
+          FindAllFn findAll = impl().findAll;
+          for(;;) {
+               std::size_t cnt = findAll(b, e, n, nlen, found, 64);
+               for (std::size_t i = 0; i < cnt; i++) {
+                    if (!fn(found[i])) return;
+               }
+               if (cnt < 64) return;
+               b = found[63]+nlen;
+          }
+     }
+
+     static std::size_t findAllScalar(const char *b, const char *e, const char *n, std::size_t nlen,
+                                   const char **out, std::size_t cap) {
+          std::size_t cnt = 0;
+          if (static_cast<std::size_t>(e - b) < nlen) return 0;
+          const char *lim = e - nlen + 1;
+          const char *p = b;
+          while (p < lim) {
+               p = static_cast<const char *>(std::memchr(p, n[0], lim - p));
+               if (p == nullptr) break;
+               if (std::memcmp(p+1, n+1, nlen-1) == 0) {
+                    out[cnt++] = p;
+                    if (cnt == cap) break;
+                    p += nlen;
+               } else {
+                    ++p;
+               }
+          }
+          return cnt;
+     }
+
+     static const char *findLastScalar(const char *b, const char *e, const char *n, std::size_t nlen) {
+          if (static_cast<std::size_t>(e - b) < nlen) return nullptr;
+          const char *p = e - nlen + 1;
+          while (p != b) {
+               --p;
+               if (*p == n[0] && std::memcmp(p+1, n+1, nlen-1) == 0) return p;
+          }
+          return nullptr;
+     }
+
+#ifdef ONDRA_SHARED_STRINGSEARCH_X86
+
+     static std::size_t findAllSSE2(const char *b, const char *e, const char *n, std::size_t nlen,
+                                   const char **out, std::size_t cap) {
+          std::size_t cnt = 0;
+          if (static_cast<std::size_t>(e - b) < nlen) return 0;
+          const std::size_t last = nlen-1;
+          const char *lim = e - last;
+          const char *p = b;
+          const char *allowed = b;
+          const __m128i vf = _mm_set1_epi8(n[0]);
+          const __m128i vl = _mm_set1_epi8(n[last]);
+          while (lim - p >= 16) {
+               unsigned int m = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(
+                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), vf),
+                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p+last)), vl))));
+               while (m) {
+                    const char *c = p + __builtin_ctz(m);
+                    m &= m - 1;
+                    if (c >= allowed && std::memcmp(c+1, n+1, last) == 0) {
+                         out[cnt++] = c;
+                         if (cnt == cap) return cnt;
+                         allowed = c + nlen;
+                    }
+               }
+               p += 16;
+          }
+          if (p < allowed) p = allowed;
+          return cnt + findAllScalar(p, e, n, nlen, out+cnt, cap-cnt);
+     }
+
+     static const char *findLastSSE2(const char *b, const char *e, const char *n, std::size_t nlen) {
+          if (static_cast<std::size_t>(e - b) < nlen) return nullptr;
+          const std::size_t last = nlen-1;
+          const char *p = e - last;
+          const __m128i vf = _mm_set1_epi8(n[0]);
+          const __m128i vl = _mm_set1_epi8(n[last]);
+          while (p - b >= 16) {
+               p -= 16;
+               unsigned int m = static_cast<unsigned int>(_mm_movemask_epi8(_mm_and_si128(
+                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p)), vf),
+                         _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(p+last)), vl))));
+               while (m) {
+                    unsigned int bit = 31 - __builtin_clz(m);
+                    if (std::memcmp(p+bit+1, n+1, last) == 0) return p+bit;
+                    m &= ~(1U << bit);
+               }
+          }
+          return findLastScalar(b, p+last, n, nlen);
+     }
+
+     __attribute__((target("avx2")))
+     static std::size_t findAllAVX2(const char *b, const char *e, const char *n, std::size_t nlen,
+                                   const char **out, std::size_t cap) {
+          std::size_t cnt = 0;
+          if (static_cast<std::size_t>(e - b) < nlen) return 0;
+          const std::size_t last = nlen-1;
+          const char *lim = e - last;
+          const char *p = b;
+          const char *allowed = b;
+          const __m256i vf = _mm256_set1_epi8(n[0]);
+          const __m256i vl = _mm256_set1_epi8(n[last]);
+          while (lim - p >= 32) {
+               unsigned int m = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(
+                         _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), vf),
+                         _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+last)), vl))));
+               while (m) {
+                    const char *c = p + __builtin_ctz(m);
+                    m &= m - 1;
+                    if (c >= allowed && std::memcmp(c+1, n+1, last) == 0) {
+                         out[cnt++] = c;
+                         if (cnt == cap) return cnt;
+                         allowed = c + nlen;
+                    }
+               }
+               p += 32;
+          }
+          if (p < allowed) p = allowed;
+          return cnt + findAllSSE2(p, e, n, nlen, out+cnt, cap-cnt);
+     }
+
+     __attribute__((target("avx2")))
+     static const char *findLastAVX2(const char *b, const char *e, const char *n, std::size_t nlen) {
+          if (static_cast<std::size_t>(e - b) < nlen) return nullptr;
+          const std::size_t last = nlen-1;
+          const char *p = e - last;
+          const __m256i vf = _mm256_set1_epi8(n[0]);
+          const __m256i vl = _mm256_set1_epi8(n[last]);
+          while (p - b >= 32) {
+               p -= 32;
+               unsigned int m = static_cast<unsigned int>(_mm256_movemask_epi8(_mm256_and_si256(
+                         _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)), vf),
+                         _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(p+last)), vl))));
+               while (m) {
+                    unsigned int bit = 31 - __builtin_clz(m);
+                    if (std::memcmp(p+bit+1, n+1, last) == 0) return p+bit;
+                    m &= ~(1U << bit);
+               }
+          }
+          return findLastSSE2(b, p+last, n, nlen);
+     }
+
+#endif
+
+protected:
+
+     static Impl select() {
+#ifdef ONDRA_SHARED_STRINGSEARCH_X86
+          if (__builtin_cpu_supports("avx2")) return Impl{&findAllAVX2, &findLastAVX2};
+          return Impl{&findAllSSE2, &findLastSSE2};
+#else
+          return Impl{&findAllScalar, &findLastScalar};
+#endif
+     }
+};
+
+}
+
+}
+
+#endif /* ONDRA_SHARED_STRINGSEARCH_H_28937461029384 */
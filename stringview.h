@@ -5,6 +5,8 @@
 #include <algorithm>
 #include <vector>
 #include <iostream>
+#include <type_traits>
+#include "stringsearch.h"
 #if __cplusplus >= 201703L
 #include <string_view>
 #endif
@@ -146,8 +148,12 @@ namespace ondra_shared {
 
           static const std::size_t npos = -1;
 
+          ///true if the search can be done on bytes (it is accelerated)
+          using ByteSearch = std::integral_constant<bool, sizeof(T) == 1 && std::is_integral<MutableType>::value>;
+
           std::size_t indexOf(const StringView<MutableType> sub, std::size_t pos = 0) const {
                if (sub.length > length) return npos;
+               if (sub.length && pos < length) return indexOf(sub, pos, ByteSearch());
                std::size_t eflen = length - sub.length + 1;
                while (pos < eflen) {
                     if (substr(pos,sub.length) == sub) return pos;
@@ -159,6 +165,7 @@ namespace ondra_shared {
 
           std::size_t lastIndexOf(const StringView<MutableType> sub, std::size_t pos = 0) const {
                if (sub.length > length) return -1;
+               if (sub.length && pos < length) return lastIndexOf(sub, pos, ByteSearch());
                std::size_t eflen = length - sub.length + 1;
                while (pos < eflen) {
                     eflen--;
@@ -235,6 +242,24 @@ namespace ondra_shared {
                return SplitFn(*this,separator, limit);
           }
 
+          ///Splits string into parts in one pass
+          /**
+           * Function finds all separators at once and calls the function for every part.
+           * Parts are same as parts returned by the function returned from split()
+           *
+           * @param separator separator. It should not be empty
+           * @param fn function receives every part
+           * @param limit allows to limit count of separators. Default is unlimited
+           */
+          template<typename Fn>
+          void splitAll(const StringViewBase &separator, Fn &&fn, unsigned int limit = (unsigned int)-1) const {
+               std::size_t startPos = 0;
+               if (limit && !separator.empty()) {
+                    splitAll(separator, fn, limit, startPos, ByteSearch());
+               }
+               if (startPos < length) fn(substr(startPos));
+          }
+
           ///Determines, whether argument has been returned as end of split cycle
           /** @retval true yes
            *  @retval false no, this string is not marked as split'send
@@ -253,6 +278,56 @@ namespace ondra_shared {
                return src;
           }
 
+     protected:
+
+          static const char *bytes(const T *ptr) {return reinterpret_cast<const char *>(ptr);}
+
+          std::size_t indexOf(const StringView<MutableType> &sub, std::size_t pos, std::true_type) const {
+               const char *b = bytes(data);
+               const char *r = _details::StringSearch::find(b+pos, b+length, bytes(sub.data), sub.length);
+               return r?r-b:npos;
+          }
+          std::size_t indexOf(const StringView<MutableType> &sub, std::size_t pos, std::false_type) const {
+               std::size_t eflen = length - sub.length + 1;
+               while (pos < eflen) {
+                    if (substr(pos,sub.length) == sub) return pos;
+                    pos++;
+               }
+               return npos;
+          }
+          std::size_t lastIndexOf(const StringView<MutableType> &sub, std::size_t pos, std::true_type) const {
+               const char *b = bytes(data);
+               const char *r = _details::StringSearch::findLast(b+pos, b+length, bytes(sub.data), sub.length);
+               return r?r-b:npos;
+          }
+          std::size_t lastIndexOf(const StringView<MutableType> &sub, std::size_t pos, std::false_type) const {
+               std::size_t eflen = length - sub.length + 1;
+               while (pos < eflen) {
+                    eflen--;
+                    if (substr(eflen,sub.length) == sub) return eflen;
+               }
+               return npos;
+          }
+          template<typename Fn>
+          void splitAll(const StringViewBase &separator, Fn &fn, unsigned int limit, std::size_t &startPos, std::true_type) const {
+               const char *b = bytes(data);
+               _details::StringSearch::forEach(b, b+length, bytes(separator.data), separator.length, [&](const char *f) {
+                    std::size_t fnd = f - b;
+                    fn(substr(startPos, fnd - startPos));
+                    startPos = fnd + separator.length;
+                    return --limit != 0;
+               });
+          }
+          template<typename Fn>
+          void splitAll(const StringViewBase &separator, Fn &fn, unsigned int limit, std::size_t &startPos, std::false_type) const {
+               std::size_t fnd;
+               while (limit && (fnd = indexOf(separator, startPos)) != npos) {
+                    fn(substr(startPos, fnd - startPos));
+                    startPos = fnd + separator.length;
+                    --limit;
+               }
+          }
+
      };
 
      template<typename T>
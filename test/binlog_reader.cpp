@@ -0,0 +1,113 @@
+/*
+ * binlog_reader.cpp
+ *
+ *  Decodes the binary log written by BinLogFile and prints it as the text log
+ *
+ *  binlog_reader [-l level] [-f from] [-t to] [-s section] [-m] [-i] <file>
+ *
+ *  -l minimal level (debug, info, progress, note, warning, error, fatal)
+ *  -f, -t time range (UTC): "YYYY-MM-DD", "YYYY-MM-DD HH:MM:SS" or unix time. The
+ *          upper bound includes whole second (whole day for the date only)
+ *  -s print only sections containing the text
+ *  -m print milliseconds
+ *  -i print index of blocks instead of messages
+ */
+
+#include <unistd.h>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+#include <limits>
+#include "../binLog.h"
+
+using namespace ondra_shared;
+
+///Parses the time
+/**
+ * @param str text
+ * @param out receives the time in microseconds
+ * @param span receives the length of the interval specified by the text in microseconds
+ * (whole day for the date only)
+ * @return true if parsed
+ */
+static bool parseTime(const char *str, std::uint64_t &out, std::uint64_t &span) {
+     struct tm tm = {};
+     int cnt = std::sscanf(str, "%d-%d-%d %d:%d:%d", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+                              &tm.tm_hour, &tm.tm_min, &tm.tm_sec);
+     if (cnt == 3 || cnt == 6) {
+          tm.tm_year -= 1900;
+          tm.tm_mon -= 1;
+          out = static_cast<std::uint64_t>(timegm(&tm)) * 1000000;
+          span = cnt == 3?std::uint64_t(86400)*1000000:1000000;
+          return true;
+     }
+     char *e;
+     unsigned long long v = std::strtoull(str, &e, 10);
+     if (*str == 0 || *e != 0) return false;
+     out = v * 1000000;
+     span = 1000000;
+     return true;
+}
+
+static int usage(const char *name) {
+     std::cerr << "Usage: " << name << " [-l level] [-f from] [-t to] [-s section] [-m] [-i] <file>" << std::endl;
+     return 1;
+}
+
+int main(int argc, char **argv) {
+     LogLevel minLevel = LogLevel::debug;
+     std::uint64_t from = 0;
+     std::uint64_t to = std::numeric_limits<std::uint64_t>::max();
+     const char *section = nullptr;
+     bool subsecond = false;
+     bool printIndex = false;
+     std::uint64_t span;
+     int c;
+     while ((c = getopt(argc, argv, "l:f:t:s:mi")) != -1) {
+          switch (c) {
+          case 'l': minLevel = LogLevelToStrTable().fromString(optarg, LogLevel::off);
+                    if (minLevel == LogLevel::off) return usage(argv[0]);
+                    break;
+          case 'f': if (!parseTime(optarg, from, span)) return usage(argv[0]);break;
+          case 't': if (!parseTime(optarg, to, span)) return usage(argv[0]);
+                    //whole second (or whole day) is included
+                    to += span - 1;
+                    break;
+          case 's': section = optarg;break;
+          case 'm': subsecond = true;break;
+          case 'i': printIndex = true;break;
+          default: return usage(argv[0]);
+          }
+     }
+     if (optind + 1 != argc) return usage(argv[0]);
+
+     BinLogReader rd;
+     if (!rd.open(argv[optind])) {
+          std::cerr << "Can't open binary log: " << argv[optind] << std::endl;
+          return 2;
+     }
+
+     if (printIndex) {
+          for (const auto &b: rd.getBlocks()) {
+               std::cout << b.offset << "\t" << b.firstTime << "\t" << b.lastTime << "\n";
+          }
+          return 0;
+     }
+
+     std::string line;
+     bool ok = rd.read(from, to, [&](const BinLogReader::Message &msg) {
+          if (msg.level < minLevel) return true;
+          if (section && (msg.section.empty() || msg.section.indexOf(section) == msg.section.npos)) return true;
+          line.clear();
+          BinLogReader::formatLine(msg, line, subsecond);
+          line.push_back('\n');
+          std::fwrite(line.data(), 1, line.size(), stdout);
+          return true;
+     });
+     if (!ok) {
+          std::cerr << "Corrupted block found" << std::endl;
+          return 3;
+     }
+     return 0;
+}
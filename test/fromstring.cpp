@@ -0,0 +1,273 @@
+/*
+ * fromstring.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ *
+ *  Compares fromString.h parsers with the strtoull / strtod and tests number
+ *  parsing of the IniConfig and CmdArgIter
+ *
+ *  - limits of 64 bit integers, the value is not changed on error
+ *  - numbers around 8 and 16 digits, which are parsed by 8 digits at once
+ *  - floats converted directly and floats converted by the slow path
+ *  - out of range, '+' and hexadecimal numbers in the IniConfig and CmdArgIter
+ */
+
+#include "../fromString.h"
+#include "../ini_config.h"
+#include "../cmdline.h"
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+
+using namespace ondra_shared;
+
+static int errors = 0;
+
+static void check(bool cond, const std::string &msg) {
+     if (!cond) {
+          std::cerr << "FAILED: " << msg << std::endl;
+          ++errors;
+     }
+}
+
+template<typename Number>
+static FromStringResult parseU(const std::string &s, Number &v) {
+     return unsignedFromString(s.data(), s.data()+s.size(), v);
+}
+
+template<typename Number>
+static FromStringResult parseS(const std::string &s, Number &v) {
+     return signedFromString(s.data(), s.data()+s.size(), v);
+}
+
+template<typename Number>
+static FromStringResult parseF(const std::string &s, Number &v) {
+     return floatFromString(s.data(), s.data()+s.size(), v);
+}
+
+static void testIntLimits() {
+     std::uint64_t u = 1;
+     auto r = parseU("18446744073709551615", u);
+     check(r && u == UINT64_MAX && r.ptr[0] == 0, "UINT64_MAX");
+     u = 1;
+     r = parseU("18446744073709551616", u);
+     check(r.ec == std::errc::result_out_of_range && u == 1, "UINT64_MAX+1 is out of range");
+     r = parseU("99999999999999999999999", u);
+     check(r.ec == std::errc::result_out_of_range && u == 1 && r.ptr[0] == 0, "all digits are consumed on overflow");
+     r = parseU("000000000000000000000000018446744073709551615", u);
+     check(r && u == UINT64_MAX, "leading zeroes");
+
+     std::uint32_t u32 = 1;
+     r = parseU("4294967296", u32);
+     check(r.ec == std::errc::result_out_of_range && u32 == 1, "UINT32_MAX+1 is out of range");
+
+     std::int64_t s = 1;
+     r = parseS("-9223372036854775808", s);
+     check(r && s == INT64_MIN, "INT64_MIN");
+     r = parseS("9223372036854775807", s);
+     check(r && s == INT64_MAX, "INT64_MAX");
+     s = 1;
+     r = parseS("-9223372036854775809", s);
+     check(r.ec == std::errc::result_out_of_range && s == 1, "INT64_MIN-1 is out of range");
+     r = parseS("9223372036854775808", s);
+     check(r.ec == std::errc::result_out_of_range && s == 1, "INT64_MAX+1 is out of range");
+     r = parseS("+1", s);
+     check(r.ec == std::errc::invalid_argument && s == 1, "'+' is not allowed");
+     r = parseS("-", s);
+     check(r.ec == std::errc::invalid_argument && s == 1, "sign without digits");
+     r = parseU("", u);
+     check(r.ec == std::errc::invalid_argument, "empty string");
+     r = parseU(" 1", u);
+     check(r.ec == std::errc::invalid_argument, "leading whitespace");
+     r = parseU("ff", u);
+     check(r.ec == std::errc::invalid_argument, "hex digits in base 10");
+     std::string hex("ffffffffffffffff");
+     r = unsignedFromString(hex.data(), hex.data()+hex.size(), u, 16);
+     check(r && u == UINT64_MAX, "base 16");
+}
+
+///Compares unsignedFromString with strtoull for numbers of all lengths around the chunk size
+static void testDigitChunks() {
+     std::mt19937_64 rnd(1);
+     const char terms[] = {'\0', 'x', '/', ':', ' ', '.', '9'};
+     //strtoull skips leading whitespace, so don't put it inside of the number
+     const char stops[] = {'x', '/', ':', '.'};
+     for (int len = 1; len <= 24; len++) {
+          for (int i = 0; i < 500; i++) {
+               std::string s;
+               for (int j = 0; j < len; j++) s.push_back(static_cast<char>('0' + rnd() % 10));
+               //put a non-digit at every position of the first two chunks
+               std::string t = s;
+               auto pos = rnd() % 20;
+               if (pos < t.size()) t[pos] = stops[rnd() % 4];
+               for (const std::string &x: {s, t}) {
+                    std::string txt = x + terms[rnd() % 7];
+                    const char *b = txt.c_str();
+                    const char *e = b + txt.size();
+                    char *se;
+                    errno = 0;
+                    unsigned long long ref = std::strtoull(b, &se, 10);
+                    bool ovr = errno == ERANGE;
+                    unsigned long long v = 12345;
+                    auto r = unsignedFromString(b, e, v);
+                    if (se == b) {
+                         check(r.ec == std::errc::invalid_argument && v == 12345, "invalid: " + txt);
+                    } else if (ovr) {
+                         check(r.ec == std::errc::result_out_of_range && r.ptr == se && v == 12345, "overflow: " + txt);
+                    } else {
+                         check(r && r.ptr == se && v == ref, "digits: " + txt);
+                    }
+               }
+          }
+     }
+}
+
+template<typename Number>
+static void compareFloat(const std::string &s) {
+     Number v = 0;
+     auto r = parseF(s, v);
+     char *e;
+     errno = 0;
+     Number ref = _details::FloatTraits<Number>::strto(s.c_str(), &e);
+     if (errno == ERANGE && (ref == 0 || std::isinf(ref))) {
+          check(r.ec == std::errc::result_out_of_range && r.ptr == e && v == 0, "float out of range: " + s);
+     } else {
+          check(r && r.ptr == e && std::memcmp(&v, &ref, sizeof(v)) == 0, "float: " + s);
+     }
+}
+
+static void testFloats() {
+     //fast path
+     for (const char *s: {"0", "-0", "1", "-1", "1.5", "0.1", "123456789012345678",
+               "9007199254740992", "1e22", "1e-22", "3.14159", "-2.5e10", "0.000001"}) {
+          compareFloat<double>(s);
+          compareFloat<float>(s);
+     }
+     //slow path: too many digits, large exponents, denormals, halfway cases
+     for (const char *s: {"12345678901234567890123", "9007199254740993", "1e23", "1e300", "1e-300",
+               "2.2250738585072014e-308", "4.9e-324", "1.7976931348623157e308",
+               "9007199254740993.0000000000000001", "0.30000000000000004", "3.4028235e38",
+               "1.00000005960464477539062", "1.4e-45"}) {
+          compareFloat<double>(s);
+          compareFloat<float>(s);
+     }
+     std::mt19937_64 rnd(2);
+     char buff[64];
+     for (int i = 0; i < 20000; i++) {
+          std::uint64_t bits = rnd();
+          double d;
+          std::memcpy(&d, &bits, sizeof(d));
+          if (!std::isfinite(d)) continue;
+          std::snprintf(buff, sizeof(buff), "%.*g", static_cast<int>(rnd() % 17 + 1), d);
+          compareFloat<double>(buff);
+          compareFloat<float>(buff);
+          //short numbers with small exponents are converted directly
+          std::snprintf(buff, sizeof(buff), "%lu.%03lue%d",
+                    static_cast<unsigned long>(rnd() % 100000), static_cast<unsigned long>(rnd() % 1000),
+                    static_cast<int>(rnd() % 40) - 20);
+          compareFloat<double>(buff);
+          compareFloat<float>(buff);
+     }
+
+     double v = 42;
+     auto r = parseF("1e400", v);
+     check(r.ec == std::errc::result_out_of_range && v == 42, "1e400 is out of range");
+     r = parseF("+1", v);
+     check(r.ec == std::errc::invalid_argument && v == 42, "'+' is not allowed in float");
+     r = parseF(".", v);
+     check(r.ec == std::errc::invalid_argument && v == 42, "single dot");
+     r = parseF("1e", v);
+     check(r && v == 1 && *r.ptr == 'e', "exponent without digits is not consumed");
+     r = parseF("1.5x", v);
+     check(r && v == 1.5 && *r.ptr == 'x', "parsing stops at first invalid character");
+}
+
+static IniConfig::Value iniValue(const char *txt) {
+     return IniConfig::Value(IniConfig::String(std::string_view(txt)), IniConfig::String());
+}
+
+template<typename Fn>
+static bool throwsOutOfRange(Fn &&fn) {
+     try {
+          fn();
+          return false;
+     } catch (const std::out_of_range &) {
+          return true;
+     }
+}
+
+static void testIniConfig() {
+     check(iniValue("18446744073709551615").getUInt() == UINT64_MAX, "ini: UINT64_MAX");
+     check(throwsOutOfRange([]{iniValue("18446744073709551616").getUInt();}), "ini: UINT64_MAX+1");
+     check(iniValue("12k").getUInt() == 12000, "ini: suffix");
+     check(throwsOutOfRange([]{iniValue("18446744073709552k").getUInt();}), "ini: suffix overflow");
+     check(throwsOutOfRange([]{iniValue("20000000000G").getUInt();}), "ini: giga overflow");
+     check(iniValue("-9223372036854775808").getInt() == INT64_MIN, "ini: INT64_MIN");
+     check(iniValue("9223372036854775807").getInt() == INT64_MAX, "ini: INT64_MAX");
+     check(throwsOutOfRange([]{iniValue("-9223372036854775809").getInt();}), "ini: INT64_MIN-1");
+     check(throwsOutOfRange([]{iniValue("9223372036854775808").getInt();}), "ini: INT64_MAX+1");
+     check(iniValue("-12k").getInt() == -12000, "ini: negative suffix");
+     check(iniValue("1.5").getNumber() == 1.5, "ini: number");
+     check(iniValue("+1.5").getNumber() == 1.5, "ini: number with '+'");
+     check(iniValue("0x10").getNumber() == 16, "ini: hexadecimal number");
+     check(iniValue("1.5k").getNumber() == 1500, "ini: number with suffix");
+}
+
+template<typename T>
+static bool cmdValue(const char *txt, std::optional<T> (CmdArgIter::*fn)(), std::optional<T> expect) {
+     const char *args[] = {txt};
+     CmdArgIter iter("fromstring", 1, args);
+     return (iter.*fn)() == expect;
+}
+
+static void testCmdLine() {
+     using U = std::uintptr_t;
+     using I = std::intptr_t;
+     using IMax = std::numeric_limits<I>;
+     using UMax = std::numeric_limits<U>;
+     std::string umax = std::to_string(UMax::max());
+     std::string umax1 = umax;
+     ++umax1.back();
+     std::string imin = std::to_string(IMax::min());
+     std::string imin1 = imin;
+     ++imin1.back();
+     std::string imax = std::to_string(IMax::max());
+     std::string imax1 = imax;
+     ++imax1.back();
+     std::string hexmax = "0x" + std::string(sizeof(U)*2, 'f');
+
+     check(cmdValue<U>(umax.c_str(), &CmdArgIter::getUInt, UMax::max()), "cmdline: uint max");
+     check(cmdValue<U>(umax1.c_str(), &CmdArgIter::getUInt, std::nullopt), "cmdline: uint max+1");
+     check(cmdValue<U>(hexmax.c_str(), &CmdArgIter::getUInt, UMax::max()), "cmdline: hexadecimal max");
+     check(cmdValue<U>("0x10", &CmdArgIter::getUInt, 16), "cmdline: 0x10");
+     check(cmdValue<U>("b101", &CmdArgIter::getUInt, 5), "cmdline: binary");
+     check(cmdValue<U>("+1", &CmdArgIter::getUInt, std::nullopt), "cmdline: '+' is not allowed");
+     check(cmdValue<U>("12x", &CmdArgIter::getUInt, std::nullopt), "cmdline: garbage after number");
+     check(cmdValue<I>(imin.c_str(), &CmdArgIter::getInt, IMax::min()), "cmdline: int min");
+     check(cmdValue<I>(imin1.c_str(), &CmdArgIter::getInt, std::nullopt), "cmdline: int min-1");
+     check(cmdValue<I>(imax.c_str(), &CmdArgIter::getInt, IMax::max()), "cmdline: int max");
+     check(cmdValue<I>(imax1.c_str(), &CmdArgIter::getInt, std::nullopt), "cmdline: int max+1");
+     check(cmdValue<I>("-0x10", &CmdArgIter::getInt, -16), "cmdline: negative hexadecimal");
+     check(cmdValue<I>("abc", &CmdArgIter::getInt, std::nullopt), "cmdline: invalid int");
+     check(cmdValue<double>("-1.5e3", &CmdArgIter::getNumber, -1500.0), "cmdline: number");
+     check(cmdValue<double>("+1.5", &CmdArgIter::getNumber, std::nullopt), "cmdline: number with '+'");
+     check(cmdValue<double>("0x10", &CmdArgIter::getNumber, std::nullopt), "cmdline: hexadecimal number");
+}
+
+int main(int, char **) {
+     testIntLimits();
+     testDigitChunks();
+     testFloats();
+     testIniConfig();
+     testCmdLine();
+     if (errors) return 1;
+     std::cout << "OK" << std::endl;
+     return 0;
+}
@@ -0,0 +1,331 @@
+/*
+ * log_output.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ *
+ *  Checks text produced by the log
+ *
+ *  - binary capture (logPrintCaptured) formats the same text as logPrint. It accepts
+ *    only LOG_PATTERN, char arrays are rejected at compile time
+ *  - LOG_PATTERN formats the same text as the string pattern. Malformed
+ *    placeholders are rejected by static_assert, so they cannot be tested here
+ *  - date header of StdLogProvider (cached per second) and subsecond precision
+ *  - lines longer than one chunk of LogLineBuffer
+ *  - setEnabledLogLevel() from other thread is seen through LogLevelCache
+ *  - rate limit applies to LOG_PATTERN sites only, char arrays are not limited
+ */
+
+#include "../stdLogOutput.h"
+#include <cstdio>
+#include <ctime>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+using namespace ondra_shared;
+
+static int errors = 0;
+
+static void check(bool cond, const char *msg) {
+     if (!cond) {
+          std::cerr << "FAILED: " << msg << std::endl;
+          ++errors;
+     }
+}
+
+///Tests whether logPrintCaptured accepts the pattern
+template<typename P, typename = void>
+struct CanCapture: std::false_type {};
+template<typename P>
+struct CanCapture<P, decltype(logPrintCaptured(std::declval<PLogProvider &>(), LogLevel::info, std::declval<const P &>()))>
+     : std::true_type {};
+
+///Provider which collects lines and captured messages
+class CollectProvider: public AbstractLogProvider {
+public:
+     std::vector<std::string> lines;
+     std::vector<std::string> captured;
+     bool captureEnabled = true;
+
+     virtual bool start(LogLevel , MutableStrViewA &buffer) override {
+          cur.clear();
+          buffer = MutableStrViewA(buff, sizeof(buff));
+          return true;
+     }
+     virtual void sendBuffer(MutableStrViewA &text) override {
+          cur.append(text.data, text.length);
+          text = MutableStrViewA(buff, sizeof(buff));
+     }
+     virtual void commit(const MutableStrViewA &text) override {
+          cur.append(text.data, text.length);
+          lines.push_back(cur);
+     }
+     virtual char *startCapture(LogLevel , std::size_t size) override {
+          if (!captureEnabled) return nullptr;
+          capbuff.resize(size);
+          return &capbuff[0];
+     }
+     virtual void commitCapture() override {
+          captured.push_back(capbuff);
+     }
+     virtual PLogProvider newSection(const StrViewA &) override {
+          return PLogProvider(new CollectProvider);
+     }
+     virtual void setProgress(float , int ) override {}
+     virtual bool isLogLevelEnabled(LogLevel ) const override {
+          return true;
+     }
+protected:
+     char buff[256];
+     std::string cur;
+     std::string capbuff;
+};
+
+///Factory which collects lines passed to the writeToLogParts
+class CollectFactory: public StdLogProviderFactory {
+public:
+     CollectFactory(LogLevel level):StdLogProviderFactory(level) {}
+
+     std::vector<std::string> lines;
+     std::vector<std::size_t> partCount;
+     std::vector<std::time_t> times;
+
+     virtual void writeToLogParts(const StrViewA *parts, std::size_t count, const std::time_t &time, LogLevel ) override {
+          std::string ln;
+          for (std::size_t i = 0; i < count; i++) ln.append(parts[i].data, parts[i].length);
+          lines.push_back(ln);
+          partCount.push_back(count);
+          times.push_back(time);
+     }
+};
+
+static void testCapture() {
+     auto pat = LOG_PATTERN("static");
+     static_assert(CanCapture<decltype(pat)>::value, "LOG_PATTERN is accepted");
+     static_assert(!CanCapture<char[7]>::value, "char array is rejected");
+     static_assert(!CanCapture<std::string>::value, "string is rejected");
+
+     CollectProvider *c = new CollectProvider;
+     PLogProvider p(c);
+     std::string str("string");
+     int x = 42;
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("int $1 neg $2 dbl $3 str $4 lit $5 ptr? $6 $$"), 123, -7, 1.5, str, "literal", &x);
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("reordered $(2) $(1) $3"), -3, 1000000000000LL, 255u);
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("no arguments"));
+     check(c->captured.size() == 3 && c->lines.empty(), "messages are captured, not formatted");
+     if (c->captured.size() != 3) return;
+
+     std::vector<std::string> formatted;
+     for (const auto &d: c->captured) {
+          std::string out;
+          logFormatCaptured(d.data(), out);
+          formatted.push_back(out);
+     }
+     //same messages formatted directly
+     c->captureEnabled = false;
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("int $1 neg $2 dbl $3 str $4 lit $5 ptr? $6 $$"), 123, -7, 1.5, str, "literal", &x);
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("reordered $(2) $(1) $3"), -3, 1000000000000LL, 255u);
+     logPrintCaptured(p, LogLevel::info, LOG_PATTERN("no arguments"));
+     logPrint(p, LogLevel::info, "int $1 neg $2 dbl $3 str $4 lit $5 ptr? $6 $$", 123, -7, 1.5, str, "literal", &x);
+     check(c->lines.size() == 4, "provider without capture receives formatted text");
+     if (c->lines.size() != 4) return;
+     for (std::size_t i = 0; i < 3; i++) {
+          check(formatted[i] == c->lines[i], "captured message formats the same text as formatted directly");
+     }
+     check(formatted[0] == c->lines[3], "captured message formats the same text as logPrint with string pattern");
+     check(formatted[0].compare(0, 40, "int 123 neg -7 dbl 1.5 str string lit li") == 0, "captured arguments");
+     check(formatted[1] == "reordered 1000000000000 -3 255", "captured arguments in different order");
+     check(formatted[2] == "no arguments", "captured message without arguments");
+
+     //captured string must not refer the original
+     c->captureEnabled = true;
+     c->captured.clear();
+     {
+          std::string tmp("temporary");
+          logPrintCaptured(p, LogLevel::info, LOG_PATTERN("tmp $1"), tmp);
+          tmp.assign("overwritten");
+     }
+     std::string out("prefix: ");
+     logFormatCaptured(c->captured[0].data(), out);
+     check(out == "prefix: tmp temporary", "captured string is copied, text is appended");
+}
+
+static void testPattern() {
+     CollectProvider *c = new CollectProvider;
+     PLogProvider p(c);
+     std::string host("localhost");
+     logPrint(p, LogLevel::info, LOG_PATTERN("Connected to $1:$2"), host, 8080);
+     logPrint(p, LogLevel::info, "Connected to $1:$2", host, 8080);
+     logPrint(p, LogLevel::info, LOG_PATTERN("$(2)-$(1) $$ $2$1"), "a", 2);
+     logPrint(p, LogLevel::info, "$(2)-$(1) $$ $2$1", "a", 2);
+     logPrint(p, LogLevel::info, LOG_PATTERN("no placeholder"));
+     std::string longText(1000, 'y');
+     logPrint(p, LogLevel::info, LOG_PATTERN("long $1 end"), longText);
+     check(c->lines.size() == 6, "all patterns logged");
+     if (c->lines.size() != 6) return;
+     check(c->lines[0] == "Connected to localhost:8080", "LOG_PATTERN text");
+     check(c->lines[0] == c->lines[1], "LOG_PATTERN formats the same text as string pattern");
+     check(c->lines[2] == "2-a $ 2a", "LOG_PATTERN with $(n) and $$");
+     check(c->lines[2] == c->lines[3], "LOG_PATTERN with $(n) formats the same text as string pattern");
+     check(c->lines[4] == "no placeholder", "LOG_PATTERN without placeholder");
+     check(c->lines[5] == "long " + longText + " end", "LOG_PATTERN over more buffers");
+}
+
+static void testRateLimit() {
+     CollectProvider *c = new CollectProvider;
+     PLogProvider p(c);
+     LogRateLimit::setLimit(1, 3);
+     for (int i = 0; i < 10; i++) {
+          logPrint(p, LogLevel::info, LOG_PATTERN("limited $1"), i);
+          logPrint(p, LogLevel::info, "literal $1", i);
+          //pattern in a buffer, which changes every time
+          char buff[20];
+          std::snprintf(buff, sizeof(buff), "buffer %d $1", i);
+          logPrint(p, LogLevel::info, buff, i);
+     }
+     LogRateLimit::setLimit(0);
+     int limited = 0, literal = 0, buffer = 0;
+     for (const std::string &ln: c->lines) {
+          if (ln.compare(0, 8, "limited ") == 0) ++limited;
+          else if (ln.compare(0, 8, "literal ") == 0) ++literal;
+          else if (ln.compare(0, 7, "buffer ") == 0) ++buffer;
+     }
+     check(limited == 3, "LOG_PATTERN is limited after the burst");
+     check(literal == 10, "string literal is not limited");
+     check(buffer == 10, "pattern in a buffer is not limited");
+     check(!LogRateLimit::isActive(), "rate limit is disabled");
+}
+
+static bool isDigits(const std::string &s, std::size_t pos, std::size_t len) {
+     if (s.length() < pos+len) return false;
+     for (std::size_t i = pos; i < pos+len; i++) if (s[i] < '0' || s[i] > '9') return false;
+     return true;
+}
+
+static std::string formatDate(std::time_t t) {
+     std::tm tinfo;
+     gmtime_r(&t, &tinfo);
+     char buff[32];
+     std::strftime(buff, sizeof(buff), "%Y-%m-%d %H:%M:%S", &tinfo);
+     return buff;
+}
+
+static void testDateHeader() {
+     auto &cache = _logDetails::LogDateCache::instance();
+     check(std::string(cache.get(0), 19) == "1970-01-01 00:00:00", "date of epoch");
+     check(std::string(cache.get(951782400), 19) == "2000-02-29 00:00:00", "date of leap day");
+     check(std::string(cache.get(951782400+86399), 19) == "2000-02-29 23:59:59", "date is refreshed in the same day");
+     check(std::string(cache.get(4102444799), 19) == "2099-12-31 23:59:59", "date of 2099");
+
+     RefCntPtr<CollectFactory> f = new CollectFactory(LogLevel::info);
+     PLogProvider p = f->create();
+     logPrint(p, LogLevel::info, "first");
+     logPrint(p, LogLevel::warning, "second");
+     f->setSubsecondPrecision(true);
+     logPrint(p, LogLevel::error, "third");
+     check(f->lines.size() == 3, "lines written to the factory");
+     if (f->lines.size() != 3) return;
+
+     for (std::size_t i = 0; i < 2; i++) {
+          const std::string &ln = f->lines[i];
+          check(ln.compare(0, 19, formatDate(f->times[i])) == 0 && ln[19] == ' ', "date header matches time of the line");
+     }
+     check(f->lines[0].compare(20, 6, "info  ") == 0, "level info");
+     check(f->lines[0][26] == '[' && isDigits(f->lines[0], 27, 4)
+               && f->lines[0].compare(31, std::string::npos, "] first") == 0, "thread ident and text");
+     check(f->lines[1].compare(20, 6, "Warn. ") == 0, "level warning");
+     check(f->lines[1].compare(26, std::string::npos, f->lines[0].substr(26, 7) + "second") == 0, "same thread ident in the second line");
+
+     const std::string &ln = f->lines[2];
+     check(ln.compare(0, 19, formatDate(f->times[2])) == 0, "date header with milliseconds");
+     check(ln[19] == '.' && isDigits(ln, 20, 3) && ln[23] == ' ', "milliseconds in the header");
+     check(ln.compare(24, 6, "Error ") == 0, "level after milliseconds");
+     check(ln.compare(ln.length()-7, 7, "] third") == 0, "text after milliseconds");
+}
+
+static void testLongLine() {
+     RefCntPtr<CollectFactory> f = new CollectFactory(LogLevel::info);
+     PLogProvider p = f->create();
+     std::string text;
+     for (int i = 0; i < 2000; i++) text.append(std::to_string(i)).push_back(',');
+     logPrint(p, LogLevel::info, "begin $1 end", text);
+     logPrint(p, LogLevel::info, "short");
+     std::string exact(_logDetails::LogLineBuffer::chunkSize * 3, 'z');
+     logPrint(p, LogLevel::info, "$1", exact);
+     check(f->lines.size() == 3, "long lines written");
+     if (f->lines.size() != 3) return;
+     const std::string &ln = f->lines[0];
+     check(ln.length() > 2 * _logDetails::LogLineBuffer::chunkSize, "line is longer than two chunks");
+     check(f->partCount[0] >= 3, "long line is passed in more parts");
+     auto pos = ln.find("] begin ");
+     check(pos != ln.npos && ln.compare(pos+8, std::string::npos, text + " end") == 0, "long line is complete");
+     check(f->partCount[1] == 1, "buffer is reused for next short line");
+     check(f->lines[1].compare(f->lines[1].length()-7, 7, "] short") == 0, "short line after long line");
+     check(f->lines[2].compare(f->lines[2].length() - exact.length(), exact.length(), exact) == 0, "line ending at chunk boundary");
+
+     //LogLineBuffer directly
+     _logDetails::LogLineBuffer buff;
+     std::string data;
+     for (std::size_t i = 0; i < 3 * _logDetails::LogLineBuffer::chunkSize + 10; i++) data.push_back(static_cast<char>('a' + i % 26));
+     buff.append(data.data(), data.length());
+     check(buff.size() == data.length(), "size of the buffer");
+     std::string joined;
+     for (const auto &s: buff.getParts()) joined.append(s.data, s.length);
+     check(joined == data && buff.getParts().size() == 4, "buffer split to chunks");
+     buff.clear();
+     check(buff.size() == 0 && buff.getParts().size() == 1 && buff.getParts()[0].length == 0, "empty buffer");
+}
+
+static void testLevelChange() {
+     RefCntPtr<CollectFactory> f = new CollectFactory(LogLevel::info);
+     f->setDefault();
+     logDebug("debug 1");
+     logInfo("info 1");
+     std::thread thr([&]{f->setEnabledLogLevel(LogLevel::warning);});
+     thr.join();
+     logInfo("info 2");
+     logWarning("warning 1");
+     check(!LogLevelCache::isEnabled(LogLevel::info) && LogLevelCache::isEnabled(LogLevel::warning), "cache follows the level");
+     thr = std::thread([&]{f->setEnabledLogLevel(LogLevel::debug);});
+     thr.join();
+     logDebug("debug 2");
+     check(LogLevelCache::isEnabled(LogLevel::debug), "cache follows the lowered level");
+
+     //other thread has own cache, the level is changed by this thread
+     bool infoEnabled = true;
+     bool infoDisabled = false;
+     thr = std::thread([&]{
+          //thread has its own provider
+          AbstractLogProvider::getInstance() = f->create();
+          infoEnabled = LogLevelCache::isEnabled(LogLevel::info);
+          f->setEnabledLogLevel(LogLevel::error);
+          infoDisabled = !LogLevelCache::isEnabled(LogLevel::info);
+          logWarning("warning 2");
+          logError("error 1");
+     });
+     thr.join();
+     check(infoEnabled && infoDisabled, "level change seen by other thread");
+     logWarning("warning 3");
+
+     std::vector<std::string> texts;
+     for (const auto &ln: f->lines) texts.push_back(ln.substr(ln.find("] ")+2));
+     std::vector<std::string> expected = {"info 1", "warning 1", "debug 2", "error 1"};
+     check(texts == expected, "only enabled levels are logged");
+     AbstractLogProvider::getInstance() = nullptr;
+}
+
+int main(int, char **) {
+     testCapture();
+     testPattern();
+     testRateLimit();
+     testDateHeader();
+     testLongLine();
+     testLevelChange();
+     if (errors) return 1;
+     std::cout << "OK" << std::endl;
+     return 0;
+}
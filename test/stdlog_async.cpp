@@ -0,0 +1,189 @@
+/*
+ * stdlog_async.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ *
+ *  Logs from many threads to StdLogFileAsync and checks the file
+ *
+ *  - lines logged by one thread are in order, no line is lost
+ *  - sections share the ring of the thread, so their lines are in order too
+ *  - long lines (written directly, bypassing the ring) keep the order
+ *  - flush() waits until all lines are in the file
+ *  - rotation during logging doesn't lose lines
+ *  - drop policy drops lines and reports their count
+ */
+
+#include "../stdLogAsync.h"
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace ondra_shared;
+
+static const char *logName = "stdlog_async.log";
+static const char *rotatedName = "stdlog_async.log.1";
+
+static constexpr int threadCount = 4;
+static constexpr int lineCount = 5000;
+
+static int errors = 0;
+
+static void check(bool cond, const char *msg) {
+     if (!cond) {
+          std::cerr << "FAILED: " << msg << std::endl;
+          ++errors;
+     }
+}
+
+///Reads lines of the file and passes them to the callback
+template<typename Fn>
+static void readLines(const char *name, Fn &&fn) {
+     std::ifstream f(name);
+     std::string ln;
+     while (std::getline(f, ln)) fn(ln);
+}
+
+///Parses "seq <thread> <index>" from the line
+static bool parseSeq(const std::string &ln, int &thr, int &idx) {
+     auto p = ln.find(" seq ");
+     if (p == ln.npos) return false;
+     return std::sscanf(ln.c_str()+p, " seq %d %d", &thr, &idx) == 2;
+}
+
+static void testOrderAndRotation() {
+     std::remove(logName);
+     std::remove(rotatedName);
+     RefCntPtr<StdLogFileAsync> lg = new StdLogFileAsync(logName, LogLevel::info,
+               StdLogFileAsync::OverflowPolicy::block, 8192);
+     std::string longText(6000, 'x');
+     std::atomic<int> progress(0);
+
+     std::vector<std::thread> thrs;
+     for (int t = 0; t < threadCount; t++) {
+          thrs.emplace_back([&, t]{
+               PLogProvider p = lg->create();
+               for (int i = 0; i < lineCount; i++) {
+                    if (i % 500 == 250) logPrint(p, LogLevel::info, "seq $1 $2 $3", t, i, longText);
+                    else logPrint(p, LogLevel::info, "seq $1 $2", t, i);
+                    ++progress;
+               }
+          });
+     }
+     //rotate while the threads are logging
+     while (progress < threadCount * lineCount / 2) std::this_thread::yield();
+     std::rename(logName, rotatedName);
+     AbstractLogProvider::rotate();
+     for (auto &t: thrs) t.join();
+     lg->flush();
+
+     std::vector<int> next(threadCount, 0);
+     bool order = true;
+     int cnt = 0;
+     auto fn = [&](const std::string &ln) {
+          int t, i;
+          if (!parseSeq(ln, t, i) || t < 0 || t >= threadCount) return;
+          if (next[t] != i) order = false;
+          next[t] = i+1;
+          ++cnt;
+     };
+     readLines(rotatedName, fn);
+     int rotatedCnt = cnt;
+     readLines(logName, fn);
+     check(rotatedCnt > 0 && cnt > rotatedCnt, "both files contain lines");
+     check(order, "lines of a thread are in order across the rotation");
+     for (int t = 0; t < threadCount; t++) check(next[t] == lineCount, "all lines written after flush()");
+
+     lg = nullptr;
+     std::remove(logName);
+     std::remove(rotatedName);
+}
+
+static void testSections() {
+     std::remove(logName);
+     RefCntPtr<StdLogFileAsync> lg = new StdLogFileAsync(logName, LogLevel::info,
+               StdLogFileAsync::OverflowPolicy::block, 4096);
+     std::vector<std::thread> thrs;
+     for (int t = 0; t < threadCount; t++) {
+          thrs.emplace_back([&, t]{
+               PLogProvider p = lg->create();
+               PLogProvider s;
+               for (int i = 0; i < lineCount; i++) {
+                    //short living sections, every line goes through other provider
+                    if (i % 2) {
+                         s = p->newSection("section");
+                         logPrint(s, LogLevel::info, "seq $1 $2", t, i);
+                    } else {
+                         logPrint(p, LogLevel::info, "seq $1 $2", t, i);
+                    }
+               }
+          });
+     }
+     for (auto &t: thrs) t.join();
+     lg->flush();
+
+     std::vector<int> next(threadCount, 0);
+     bool order = true;
+     readLines(logName, [&](const std::string &ln) {
+          int t, i;
+          if (!parseSeq(ln, t, i) || t < 0 || t >= threadCount) return;
+          if (next[t] != i) order = false;
+          next[t] = i+1;
+     });
+     check(order, "lines of sections are in order with lines of the thread");
+     for (int t = 0; t < threadCount; t++) check(next[t] == lineCount, "all lines of sections written");
+     lg = nullptr;
+     std::remove(logName);
+}
+
+static void testDrop() {
+     std::remove(logName);
+     RefCntPtr<StdLogFileAsync> lg = new StdLogFileAsync(logName, LogLevel::info,
+               StdLogFileAsync::OverflowPolicy::drop, 4096);
+     std::vector<std::thread> thrs;
+     for (int t = 0; t < threadCount; t++) {
+          thrs.emplace_back([&, t]{
+               PLogProvider p = lg->create();
+               for (int i = 0; i < lineCount; i++) logPrint(p, LogLevel::info, "seq $1 $2", t, i);
+          });
+     }
+     for (auto &t: thrs) t.join();
+     lg->flush();
+     std::size_t dropped = lg->getDropped();
+     //the report is written by the writer thread after the lines
+     lg = nullptr;
+
+     std::size_t written = 0;
+     std::size_t reported = 0;
+     std::vector<int> last(threadCount, -1);
+     bool order = true;
+     readLines(logName, [&](const std::string &ln) {
+          int t, i;
+          unsigned long d;
+          if (parseSeq(ln, t, i) && t >= 0 && t < threadCount) {
+               if (i <= last[t]) order = false;
+               last[t] = i;
+               ++written;
+          } else if (std::sscanf(ln.c_str(), "... %lu log line(s) dropped", &d) == 1) {
+               reported += d;
+          }
+     });
+     check(dropped > 0, "lines are dropped when the ring is full");
+     check(written + dropped == static_cast<std::size_t>(threadCount * lineCount), "written and dropped lines match");
+     check(reported == dropped, "count of dropped lines is reported in the log");
+     check(order, "lines are in order when some are dropped");
+     std::remove(logName);
+}
+
+int main(int, char **) {
+     testOrderAndRotation();
+     testSections();
+     testDrop();
+     if (errors) return 1;
+     std::cout << "OK" << std::endl;
+     return 0;
+}
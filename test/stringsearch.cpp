@@ -0,0 +1,198 @@
+/*
+ * stringsearch.cpp
+ *
+ *  Created on: 18. 10. 2026
+ *      Author: ondra
+ *
+ *  Compares every implementation of the StringSearch (scalar, SSE2, AVX2) with
+ *  a naive search
+ *
+ *  - haystacks of all lengths around the vector size at different alignments
+ *  - needles which straddle 16 and 32 byte boundaries, 1 byte needles
+ *  - more occurrences than fits to one batch of the forEach
+ *  - indexOf, lastIndexOf with the starting position, empty needles
+ *  - splitAll with limits gives the same parts as split()
+ */
+
+#include "../stringview.h"
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ondra_shared;
+using _details::StringSearch;
+
+static int errors = 0;
+
+static void check(bool cond, const std::string &msg) {
+     if (!cond) {
+          std::cerr << "FAILED: " << msg << std::endl;
+          ++errors;
+     }
+}
+
+static const std::size_t npos = StrViewA::npos;
+
+static std::size_t naiveIndexOf(const std::string &h, const std::string &n, std::size_t pos) {
+     for (std::size_t i = pos; i + n.size() <= h.size(); i++) {
+          if (h.compare(i, n.size(), n) == 0) return i;
+     }
+     return npos;
+}
+
+static std::size_t naiveLastIndexOf(const std::string &h, const std::string &n, std::size_t pos) {
+     std::size_t r = npos;
+     for (std::size_t i = pos; i + n.size() <= h.size(); i++) {
+          if (h.compare(i, n.size(), n) == 0) r = i;
+     }
+     return r;
+}
+
+///Non-overlapping occurrences from the beginning
+static std::vector<std::size_t> naiveFindAll(const std::string &h, const std::string &n) {
+     std::vector<std::size_t> r;
+     std::size_t p = 0;
+     while ((p = naiveIndexOf(h, n, p)) != npos) {
+          r.push_back(p);
+          p += n.size();
+     }
+     return r;
+}
+
+static std::vector<std::string> naiveSplit(const std::string &h, const std::string &sep, unsigned int limit) {
+     std::vector<std::string> r;
+     std::size_t start = 0;
+     std::size_t f;
+     while (limit && (f = naiveIndexOf(h, sep, start)) != npos) {
+          r.push_back(h.substr(start, f - start));
+          start = f + sep.size();
+          --limit;
+     }
+     if (start < h.size()) r.push_back(h.substr(start));
+     return r;
+}
+
+struct NamedImpl {
+     const char *name;
+     StringSearch::Impl impl;
+};
+
+static std::vector<NamedImpl> implementations() {
+     std::vector<NamedImpl> r;
+     r.push_back(NamedImpl{"scalar", StringSearch::Impl{&StringSearch::findAllScalar, &StringSearch::findLastScalar}});
+#ifdef ONDRA_SHARED_STRINGSEARCH_X86
+     r.push_back(NamedImpl{"SSE2", StringSearch::Impl{&StringSearch::findAllSSE2, &StringSearch::findLastSSE2}});
+     if (__builtin_cpu_supports("avx2")) {
+          r.push_back(NamedImpl{"AVX2", StringSearch::Impl{&StringSearch::findAllAVX2, &StringSearch::findLastAVX2}});
+     } else {
+          std::cout << "AVX2 is not supported, skipped" << std::endl;
+     }
+#endif
+     return r;
+}
+
+///Creates haystack from a small alphabet, so there are many partial matches
+static std::string randomText(std::mt19937 &rnd, std::size_t len, int alphabet) {
+     std::string s;
+     for (std::size_t i = 0; i < len; i++) s.push_back(static_cast<char>('a' + rnd() % alphabet));
+     return s;
+}
+
+static void testFind(const NamedImpl &ni, std::mt19937 &rnd) {
+     std::string name(ni.name);
+     //haystack is copied at different offsets of this buffer
+     std::vector<char> buffer(512);
+     for (std::size_t len = 0; len <= 200; len++) {
+          for (int i = 0; i < 20; i++) {
+               std::string h = randomText(rnd, len, 2 + i % 3);
+               std::size_t ofs = rnd() % 32;
+               std::memcpy(buffer.data()+ofs, h.data(), h.size());
+               //bytes after the haystack must be ignored
+               buffer[ofs+len] = h.empty()?'a':h[0];
+               const char *b = buffer.data()+ofs;
+               const char *e = b + len;
+               std::string n;
+               if (len && i % 4 != 0) {
+                    //needle which exists in the haystack, often crossing 16 or 32 byte boundary
+                    std::size_t nlen = 1 + rnd() % std::min<std::size_t>(len, 40);
+                    std::size_t pos = i % 2?(rnd() % (len - nlen + 1))
+                                        :std::min<std::size_t>(len - nlen, (16 << (rnd() % 2)) - nlen / 2);
+                    n = h.substr(pos, nlen);
+               } else {
+                    n = randomText(rnd, 1 + rnd() % 5, 3);
+               }
+               std::string ctx = name + ": '" + n + "' in '" + h + "'";
+
+               std::vector<std::size_t> expect = naiveFindAll(h, n);
+               //collect occurrences with different capacities to test continuation
+               for (std::size_t cap: {std::size_t(1), std::size_t(3), std::size_t(64)}) {
+                    std::vector<std::size_t> found;
+                    const char *p = b;
+                    const char *out[64];
+                    for(;;) {
+                         std::size_t cnt = ni.impl.findAll(p, e, n.data(), n.size(), out, cap);
+                         for (std::size_t j = 0; j < cnt; j++) found.push_back(out[j] - b);
+                         if (cnt < cap) break;
+                         p = out[cap-1] + n.size();
+                    }
+                    check(found == expect, "findAll " + ctx);
+               }
+               const char *last = ni.impl.findLast(b, e, n.data(), n.size());
+               check((last?static_cast<std::size_t>(last - b):npos) == naiveLastIndexOf(h, n, 0), "findLast " + ctx);
+          }
+     }
+}
+
+static void testStringView(const NamedImpl &ni, std::mt19937 &rnd) {
+     std::string name(ni.name);
+     StringSearch::impl() = ni.impl;
+     for (std::size_t len = 0; len <= 100; len++) {
+          std::string h = randomText(rnd, len, 3);
+          StrViewA hv(h);
+          for (std::size_t nlen = 0; nlen <= 3; nlen++) {
+               std::string n = randomText(rnd, nlen, 3);
+               StrViewA nv(n);
+               std::string ctx = name + ": '" + n + "' in '" + h + "'";
+               std::size_t pos = rnd() % (len + 2);
+               check(hv.indexOf(nv, pos) == naiveIndexOf(h, n, pos), "indexOf " + ctx);
+               check(hv.lastIndexOf(nv, pos) == naiveLastIndexOf(h, n, pos), "lastIndexOf " + ctx);
+               if (n.empty()) continue;
+               for (unsigned int limit: {0U, 1U, 2U, 5U, 70U, static_cast<unsigned int>(-1)}) {
+                    std::vector<std::string> parts;
+                    hv.splitAll(nv, [&](StrViewA s) {parts.push_back(std::string(s.data, s.length));}, limit);
+                    check(parts == naiveSplit(h, n, limit), "splitAll " + ctx);
+                    std::vector<std::string> sparts;
+                    auto fn = hv.split(nv, limit);
+                    for (StrViewA s = fn(); !hv.isSplitEnd(s); s = fn()) sparts.push_back(std::string(s.data, s.length));
+                    check(sparts == parts, "split " + ctx);
+               }
+          }
+          std::vector<std::string> parts;
+          hv.splitAll("", [&](StrViewA s) {parts.push_back(std::string(s.data, s.length));});
+          check(parts == naiveSplit(h, "", 0), name + ": splitAll with empty separator");
+     }
+     //more separators than one batch of the forEach
+     std::string many;
+     for (int i = 0; i < 300; i++) many.append(std::to_string(i)).append(", ");
+     StrViewA mv(many);
+     for (unsigned int limit: {63U, 64U, 65U, 128U, 200U, static_cast<unsigned int>(-1)}) {
+          std::vector<std::string> parts;
+          mv.splitAll(", ", [&](StrViewA s) {parts.push_back(std::string(s.data, s.length));}, limit);
+          check(parts == naiveSplit(many, ", ", limit), name + ": splitAll many separators, limit " + std::to_string(limit));
+     }
+}
+
+int main(int, char **) {
+     std::mt19937 rnd(1);
+     StringSearch::Impl selected = StringSearch::impl();
+     for (const NamedImpl &ni: implementations()) {
+          testFind(ni, rnd);
+          testStringView(ni, rnd);
+     }
+     StringSearch::impl() = selected;
+     if (errors) return 1;
+     std::cout << "OK" << std::endl;
+     return 0;
+}
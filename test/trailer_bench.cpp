@@ -0,0 +1,54 @@
+/*
+ * trailer_bench.cpp
+ *
+ *  Compares cost of the trailers against plain RAII guards. Each test
+ *  creates a chain of deferred actions (as in deeply nested cleanup scopes)
+ *  and releases it at the end of the scope
+ */
+
+#include <chrono>
+#include <iostream>
+#include "../trailer.h"
+
+using namespace ondra_shared;
+
+static volatile unsigned int counter = 0;
+
+struct Guard {
+     unsigned int val;
+     ~Guard() {counter = counter + val;}
+};
+
+static void raii_chain(unsigned int depth) {
+     if (depth == 0) return;
+     Guard g{depth};
+     raii_chain(depth-1);
+}
+
+template<typename T>
+static void trailer_chain(unsigned int depth) {
+     T t;
+     for (unsigned int i = 0; i < depth; i++) {
+          t.push([i]{counter = counter + i;});
+     }
+}
+
+template<typename Fn>
+static void measure(const char *name, unsigned int depth, unsigned int repeat, Fn &&fn) {
+     auto start = std::chrono::steady_clock::now();
+     for (unsigned int i = 0; i < repeat; i++) fn(depth);
+     auto end = std::chrono::steady_clock::now();
+     auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+     std::cout << name << " depth=" << depth << ": "
+               << static_cast<double>(ns)/(static_cast<double>(repeat)*depth) << " ns/action" << std::endl;
+}
+
+int main(int argc, char **argv) {
+     const unsigned int repeat = 10000;
+     for (unsigned int depth: {4U, 32U, 256U}) {
+          measure("raii guards    ", depth, repeat, raii_chain);
+          measure("trailer (heap) ", depth, repeat, trailer_chain<Trailer<> >);
+          measure("trailer (arena)", depth, repeat, trailer_chain<ArenaTrailer<> >);
+     }
+     return 0;
+}
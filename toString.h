@@ -4,18 +4,138 @@
 #define _ONDRA_SHARED_TOSTRING_H_39289204239042_
 
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <algorithm>
+
+#if __cplusplus >= 201703L && defined(__has_include)
+#if __has_include(<charconv>)
+#include <charconv>
+#endif
+#endif
+
+#if defined(__cpp_lib_to_chars)
+#define ONDRA_SHARED_TOSTRING_HAS_TO_CHARS 1
+#endif
 
 namespace ondra_shared {
 
+///Size of buffer sufficient for any integer number written by unsignedToBuffer or signedToBuffer
+/**
+ * @note if leftZeroes is used, the buffer must be at least leftZeroes+1 bytes long
+ */
+template<typename Number>
+constexpr std::size_t numberBufferSize();
+
+///Size of buffer sufficient for any number written by floatToBuffer
+static constexpr std::size_t floatBufferSize = 32;
+
+namespace _details {
+
+     ///Table of all two-digit pairs "00" to "99"
+     inline const char *digitPairs() {
+          static const char table[] =
+               "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+               "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+               "8081828384858687888990919293949596979899";
+          return table;
+     }
+
+     template<typename Number>
+     using UnsignedOf = typename std::conditional<(sizeof(Number) > sizeof(unsigned long)),
+                                             unsigned long long, unsigned long>::type;
+
+     ///Writes digits of the number backward, ending at the end
+     /**
+      * @param n number
+      * @param base base
+      * @param end pointer after the last digit
+      * @return pointer to the first digit. For zero, no digits are written
+      */
+     template<typename U>
+     char *unsignedDigits(U n, unsigned int base, char *end) {
+          char *p = end;
+          if (base == 10) {
+               const char *pairs = digitPairs();
+               while (n >= 100) {
+                    unsigned int r = static_cast<unsigned int>(n % 100);
+                    n /= 100;
+                    p-=2;
+                    std::memcpy(p, pairs+2*r, 2);
+               }
+               if (n >= 10) {
+                    p-=2;
+                    std::memcpy(p, pairs+2*n, 2);
+               } else if (n) {
+                    *--p = static_cast<char>('0'+n);
+               }
+          } else {
+               while (n) {
+                    unsigned int remainder = static_cast<unsigned int>(n % base);
+                    n /= base;
+                    if (remainder < 10) *--p = static_cast<char>(remainder+'0');
+                    else if (remainder < 36) *--p = static_cast<char>(remainder+'A'-10);
+                    else *--p = static_cast<char>(remainder+'a'-36);
+               }
+          }
+          return p;
+     }
+
+     template<typename Number>
+     constexpr std::size_t maxDigits() {return sizeof(UnsignedOf<Number>)*8;}
+
+     template<typename Number>
+     UnsignedOf<Number> absValue(const Number &n) {
+          //works for the most negative value too
+          return UnsignedOf<Number>(0) - static_cast<UnsignedOf<Number> >(n);
+     }
+
+}
+
+template<typename Number>
+constexpr std::size_t numberBufferSize() {return _details::maxDigits<Number>()+2;}
+
+///Writes unsigned number to the buffer
+/**
+ * @param n number
+ * @param buff buffer. It must have space at least numberBufferSize<Number>() bytes
+ * @param base base (2-62)
+ * @param leftZeroes minimal count of digits, missing digits are filled with zeroes
+ * @return pointer after last written character
+ */
+template<typename Number>
+char *unsignedToBuffer(const Number &n, char *buff, int base=10, int leftZeroes=1) {
+     char tmp[_details::maxDigits<Number>()];
+     char *end = tmp+sizeof(tmp);
+     char *p = _details::unsignedDigits(static_cast<_details::UnsignedOf<Number> >(n), base, end);
+     for (int cnt = static_cast<int>(end - p); cnt < leftZeroes; ++cnt) *buff++ = '0';
+     std::size_t len = end - p;
+     std::memcpy(buff, p, len);
+     return buff+len;
+}
+
+///Writes signed number to the buffer
+/** @copydetails unsignedToBuffer */
+template<typename Number>
+char *signedToBuffer(const Number &n, char *buff, int base=10, int leftZeroes=1) {
+     if (n < 0) {
+          *buff++ = '-';
+          return unsignedToBuffer(_details::absValue(n), buff, base, leftZeroes);
+     } else {
+          return unsignedToBuffer(n, buff, base, leftZeroes);
+     }
+}
+
 template<typename Number, typename Fn>
 void unsignedToString(const Number &n, Fn &&fn, int base=10, int leftZeroes=1) {
-
-     if (n == 0 && leftZeroes<1) return;
-     unsignedToString(n/base, fn, base, leftZeroes-1);
-     unsigned int remainder = (unsigned int)(n % base);
-     if (remainder < 10) fn(remainder+'0');
-     else if (remainder < 36) fn(remainder+'A'-10);
-     else fn(remainder+'a'-36);
+     char tmp[_details::maxDigits<Number>()];
+     char *end = tmp+sizeof(tmp);
+     char *p = _details::unsignedDigits(static_cast<_details::UnsignedOf<Number> >(n), base, end);
+     for (int cnt = static_cast<int>(end - p); cnt < leftZeroes; ++cnt) fn('0');
+     while (p != end) fn(*p++);
 }
 
 template<typename Number, typename Fn>
@@ -23,113 +143,230 @@ void signedToString(const Number &n, Fn &&fn, int base=10, int leftZeroes=1) {
 
      if (n < 0) {
           fn('-');
-          unsignedToString(-n,fn,base,leftZeroes);
+          unsignedToString(_details::absValue(n),fn,base,leftZeroes);
      } else {
           unsignedToString(n,fn,base,leftZeroes);
      }
 }
 
+namespace _details {
 
+     inline char *writeInfinity(bool sign, char *buff) {
+          static const char inf[] = "∞";
+          if (sign) *buff++ = '-';
+          std::memcpy(buff, inf, sizeof(inf)-1);
+          return buff + sizeof(inf)-1;
+     }
 
-template<typename Number, typename Fn>
-void floatToString(Number value, Fn &&fn, int maxPrecisionDigits=8) {
-     static std::uintptr_t fracMultTable[10] = {
-                    1, //0
-                    10, //1
-                    100, //2
-                    1000, //3
-                    10000, //4
-                    100000, //5
-                    1000000, //6
-                    10000000, //7
-                    100000000, //8
-                    1000000000 //9
-          };
-     const char *inf = "∞";
-
-          bool sign = value < 0;
-          std::uintptr_t precisz = std::min<std::uintptr_t>(maxPrecisionDigits, 9);
-
-          value = std::abs(value);
-          //calculate exponent of value
-          //123897 -> 5 (1.23897e5)
-          //0.001248 -> 3 (1.248e-3)
-          double fexp = floor(log10(std::abs(value)));
-
-          if (!std::isfinite(fexp)) {
-               if (fexp < 0) {
-                    fn('0');
-               } else {
-                    if (sign) fn('-');
-                    const char *z = inf;
-                    while (*z) fn(*z++);
-               }
-               return;
+     inline char *writeNan(char *buff) {
+          std::memcpy(buff, "nan", 3);
+          return buff+3;
+     }
+
+     ///Removes zeroes at the end of the fraction, and the dot, if there is no fraction
+     inline char *trimFraction(char *beg, char *end) {
+          if (std::find(beg, end, '.') == end) return end;
+          while (end[-1] == '0') --end;
+          if (end[-1] == '.') --end;
+          return end;
+     }
+
+#ifndef ONDRA_SHARED_TOSTRING_HAS_TO_CHARS
+     ///Replaces decimal point of the current locale
+     inline void fixDecimalPoint(char *beg, char *end) {
+          for (char *c = beg; c != end; ++c) {
+               if (*c != '-' && (*c < '0' || *c > '9')) *c = '.';
           }
+     }
+#endif
 
-          //convert it to integer
-          std::intptr_t iexp = (std::intptr_t)fexp;
-          //if exponent is in some reasonable range, set iexp to 0
-          if (iexp > -3 && iexp < 8) {
-               iexp = 0;
+     ///Reads significant digits and exponent of a number written in scientific format
+     /**
+      * @param beg begin of the text ("-1.2345e+06", decimal point can be any character)
+      * @param end end of the text
+      * @param digits receives digits without the decimal point and without trailing zeroes
+      * @param count receives count of digits
+      * @return decimal exponent of the first digit
+      */
+     inline int parseScientific(const char *beg, const char *end, char *digits, int &count) {
+          count = 0;
+          while (beg != end && *beg != 'e' && *beg != 'E') {
+               if (*beg >= '0' && *beg <= '9') digits[count++] = *beg;
+               ++beg;
           }
-          else {
-               //otherwise normalize number to be between 1 and 10
-               value = value * pow(0.1, iexp);
+          if (count == 0) digits[count++] = '0';
+          while (count > 1 && digits[count-1] == '0') --count;
+          if (beg == end) return 0;
+          ++beg;
+          bool neg = *beg == '-';
+          if (*beg == '-' || *beg == '+') ++beg;
+          int exp = 0;
+          while (beg != end) exp = exp * 10 + (*beg++ - '0');
+          return neg?-exp:exp;
+     }
+
+     ///Writes number given by its significant digits and exponent in the form d.ddde+N
+     /**
+      * @param sign true to write minus sign
+      * @param digits significant digits
+      * @param count count of digits
+      * @param exp decimal exponent of the first digit
+      * @param buff output buffer
+      * @return pointer after last written character
+      */
+     inline char *writeExponent(bool sign, const char *digits, int count, int exp, char *buff) {
+          if (sign) *buff++ = '-';
+          *buff++ = digits[0];
+          if (count > 1) {
+               *buff++ = '.';
+               std::memcpy(buff, digits+1, count-1);
+               buff += count-1;
           }
-          double fint;
-          //separate number to integer and fraction
-          double frac = modf(value, &fint);
-          //calculate multiplication of fraction
-          std::uintptr_t fractMultiply = fracMultTable[precisz];
-          //multiplicate fraction to receive best rounded number to given decimal places
-          double fm = floor(frac * fractMultiply +0.5);
-
-          //convert finteger to integer
-          std::uintptr_t intp(fint);
-          //mantisa as integer number (without left zeroes)
-          std::uintptr_t m(fm);
-
-
-          //if floating multiplied fraction is above or equal fractMultiply
-          //something very bad happen, probably rounding error happened, so we need adjust
-          if (m >= fractMultiply) {
-               //increment integer part number
-               intp = intp+1;
-               //decrease fm
-               m-=fractMultiply;
-               //if integer part is equal or above 10
-               if (intp >= 10 && iexp) {
-                    //set  integer part to 1 (because 9.99999 -> 10 -> 1e1)
-                    intp=1;
-                    //increase exponent
-                    iexp++;
+          *buff++ = 'e';
+          if (exp > 0) *buff++ = '+';
+          return signedToBuffer(exp, buff);
+     }
+
+     ///Writes number given by its significant digits and exponent
+     /**
+      * Numbers with exponent between -2 and 7 are written without exponent, other numbers
+      * are written as d.ddde+N (same format as floatToBuffer with limited precision)
+      *
+      * @param sign true to write minus sign
+      * @param digits significant digits
+      * @param count count of digits
+      * @param exp decimal exponent of the first digit
+      * @param buff output buffer
+      * @return pointer after last written character
+      */
+     inline char *writeDecimal(bool sign, const char *digits, int count, int exp, char *buff) {
+          if (sign) *buff++ = '-';
+          if (exp > -3 && exp < 8) {
+               if (exp < 0) {
+                    *buff++ = '0';
+                    *buff++ = '.';
+                    for (int i = exp+1; i < 0; i++) *buff++ = '0';
+                    std::memcpy(buff, digits, count);
+                    return buff+count;
+               }
+               for (int i = 0; i <= exp; i++) *buff++ = i < count?digits[i]:'0';
+               if (count > exp+1) {
+                    *buff++ = '.';
+                    std::memcpy(buff, digits+exp+1, count-exp-1);
+                    buff += count-exp-1;
                }
+               return buff;
           }
+          return writeExponent(false, digits, count, exp, buff);
+     }
 
-          //write signum for negative number
-          if (sign) fn('-');
-          //write absolute integer number (remove sign)
-          unsignedToString(intp,fn);
-          std::uintptr_t digits = precisz;
-
-          if (m) {
-               //put dot
-               fn('.');
-               //remove any rightmost zeroes
-               while (m && (m % 10) == 0) {m = m / 10;--digits;}
-               //write final number
-               unsignedToString(m,fn,10, digits);
-          }
-          //if exponent is set
-          if (iexp) {
-               //put E
-               fn('e');
-               if (iexp > 0) fn('+');
-               //write signed exponent
-               signedToString(iexp,fn,10);
-          }
-          //all done
+}
+
+///Writes floating number to the buffer - shortest representation, which can be read back exactly
+/**
+ * Numbers between 0.01 and 99999999 are written without exponent, other numbers are
+ * written with an exponent (1.5e+8, 5e-324). The result doesn't depend on the locale nor
+ * on the standard library
+ *
+ * @param value value to write
+ * @param buff buffer, it must have space at least floatBufferSize bytes
+ * @return pointer after last written character
+ *
+ * @note uses std::to_chars if available. Otherwise, the number is formatted by
+ * snprintf with the least precision which reads back exactly
+ */
+template<typename Number>
+char *floatToBuffer(Number value, char *buff) {
+     if (std::isnan(value)) return _details::writeNan(buff);
+     if (std::isinf(value)) return _details::writeInfinity(value < 0, buff);
+     if (value == 0) {
+          *buff = '0';
+          return buff+1;
+     }
+     char tmp[floatBufferSize+16];
+     char digits[floatBufferSize+16];
+     int count;
+#ifdef ONDRA_SHARED_TOSTRING_HAS_TO_CHARS
+     char *end = std::to_chars(tmp, tmp+sizeof(tmp), value, std::chars_format::scientific).ptr;
+#else
+     //find least precision which reads back exactly (locale is same for both directions)
+     auto print = [&](int digits) {
+          return tmp+std::snprintf(tmp, sizeof(tmp), "%.*e", digits-1, static_cast<double>(value));
+     };
+     int lo = 1;
+     int hi = std::is_same<Number, float>::value?9:17;
+     while (lo < hi) {
+          int mid = (lo + hi) / 2;
+          print(mid);
+          if (static_cast<Number>(std::strtod(tmp, nullptr)) == value) hi = mid;
+          else lo = mid+1;
+     }
+     char *end = print(lo);
+#endif
+     int exp = _details::parseScientific(tmp, end, digits, count);
+     return _details::writeDecimal(value < 0, digits, count, exp, buff);
+}
+
+///Writes floating number to the buffer with limited precision
+/**
+ * Numbers between 0.001 and 99999999 are written without exponent, other numbers are
+ * normalized and written with an exponent. Zeroes at the end of the fraction are not written
+ *
+ * @param value value to write
+ * @param buff buffer, it must have space at least floatBufferSize bytes
+ * @param maxPrecisionDigits maximum count of digits after the decimal point (max 9). If negative,
+ * the shortest exact representation is written (see floatToBuffer(Number, char *))
+ * @return pointer after last written character
+ */
+template<typename Number>
+char *floatToBuffer(Number value, char *buff, int maxPrecisionDigits) {
+     if (maxPrecisionDigits < 0) return floatToBuffer(value, buff);
+     if (std::isnan(value)) return _details::writeNan(buff);
+     if (std::isinf(value)) return _details::writeInfinity(value < 0, buff);
+     if (value == 0) {
+          *buff = '0';
+          return buff+1;
+     }
+     int precisz = std::min(maxPrecisionDigits, 9);
+     //form is chosen by the exponent of the value before rounding
+     int fexp = static_cast<int>(std::floor(std::log10(std::abs(value))));
+     if (fexp > -3 && fexp < 8) {
+#ifdef ONDRA_SHARED_TOSTRING_HAS_TO_CHARS
+          char *end = std::to_chars(buff, buff+floatBufferSize, value, std::chars_format::fixed, precisz).ptr;
+#else
+          char *end = buff+std::snprintf(buff, floatBufferSize, "%.*f", precisz, static_cast<double>(value));
+          _details::fixDecimalPoint(buff, end);
+#endif
+          return _details::trimFraction(buff, end);
+     } else {
+          char tmp[floatBufferSize+16];
+          char digits[floatBufferSize+16];
+          int count;
+#ifdef ONDRA_SHARED_TOSTRING_HAS_TO_CHARS
+          char *end = std::to_chars(tmp, tmp+sizeof(tmp), value, std::chars_format::scientific, precisz).ptr;
+#else
+          char *end = tmp+std::snprintf(tmp, sizeof(tmp), "%.*e", precisz, static_cast<double>(value));
+#endif
+          int exp = _details::parseScientific(tmp, end, digits, count);
+          return _details::writeExponent(value < 0, digits, count, exp, buff);
+     }
+}
+
+
+///Writes floating number
+/**
+ * @param value value to write
+ * @param fn function which receives characters
+ * @param maxPrecisionDigits maximum count of digits after decimal point. Set -1 to
+ * write shortest exact representation
+ *
+ * @see floatToBuffer
+ */
+template<typename Number, typename Fn>
+void floatToString(Number value, Fn &&fn, int maxPrecisionDigits=8) {
+     char buff[floatBufferSize];
+     char *end = floatToBuffer(value, buff, maxPrecisionDigits);
+     for (char *c = buff; c != end; ++c) fn(*c);
 }
 
 }
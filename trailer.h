@@ -7,7 +7,9 @@
 
 #ifndef SRC_ONDRA_SHARED_TRAILER_H_6765144087064
 #define SRC_ONDRA_SHARED_TRAILER_H_6765144087064
+#include <cstddef>
 #include <memory>
+#include <new>
 
 namespace ondra_shared {
 
@@ -34,23 +36,132 @@ template<typename Fn> auto trailer(Fn &&fn);
 /**
  * Trailer object can be constructed empty. To reduce allocations, you can reserve
  * some bytes on stack where trailer functions are placed. If this space is exhausted,
- * further trailers are allocated on the stack
+ * further trailers are allocated on the heap, or in the arena (see below)
  *
  * @param buffsz space reserved for trailers. Default value allows to store trailer consists
  * from 14x pointer-sized variables + 1x vtable + 1x pointer to the function
  *
+ * @param arena set true to enable growable arena. When the reserved space is exhausted,
+ * trailers are placed into pages taken from a thread local pool. Pages are returned
+ * to the pool of the current thread when trailer is destroyed or cleared. This
+ * is useful for long chains of trailers, because the global heap is not used.
  */
-template<std::size_t buffsz=sizeof(void *)*16> class Trailer;
+template<std::size_t buffsz=sizeof(void *)*16, bool arena = false> class Trailer;
+
+///Trailer which uses the growable arena
+template<std::size_t buffsz=sizeof(void *)*16>
+using ArenaTrailer = Trailer<buffsz, true>;
 
 
 
 class Trailer_Defs {
 public:
+
+    ///Page of the arena
+    struct Page {
+        Page *next;
+        std::size_t pos;
+    };
+
+    static constexpr std::size_t page_size = 4096;
+    static constexpr std::size_t page_header = (sizeof(Page)+alignof(std::max_align_t)-1)
+                                                & ~(alignof(std::max_align_t)-1);
+
+    ///Thread local pool of pages
+    class PagePool {
+    public:
+        static constexpr unsigned int max_cached = 16;
+
+        ~PagePool() {
+            while (free_list) {
+                Page *p = free_list;
+                free_list = p->next;
+                ::operator delete(p);
+            }
+        }
+
+        Page *get() {
+            Page *p = free_list;
+            if (p) {
+                free_list = p->next;
+                --count;
+            } else {
+                p = reinterpret_cast<Page *>(::operator new(page_size));
+            }
+            p->next = nullptr;
+            p->pos = page_header;
+            return p;
+        }
+
+        ///Returns chain of pages to the pool
+        void put(Page *chain) {
+            while (chain) {
+                Page *p = chain;
+                chain = chain->next;
+                if (count < max_cached) {
+                    p->next = free_list;
+                    free_list = p;
+                    ++count;
+                } else {
+                    ::operator delete(p);
+                }
+            }
+        }
+
+        static PagePool &instance() {
+            static thread_local PagePool pool;
+            return pool;
+        }
+
+    protected:
+        Page *free_list = nullptr;
+        unsigned int count = 0;
+    };
+
+    ///Allocates space for the trailers - in reserved buffer and then in pages
+    struct Arena {
+        char *buff;
+        std::size_t &pos;
+        std::size_t size;
+        ///pointer to list of pages, nullptr if the arena is not growable
+        Page **pages;
+
+        void *alloc(std::size_t sz, std::size_t align) {
+            std::size_t p = align_pos(buff, pos, align);
+            if (p+sz <= size) {
+                pos = p+sz;
+                return buff+p;
+            }
+            if (pages == nullptr || sz+page_header > page_size) return nullptr;
+            Page *pg = *pages;
+            if (pg) {
+                char *base = reinterpret_cast<char *>(pg);
+                p = align_pos(base, pg->pos, align);
+                if (p+sz <= page_size) {
+                    pg->pos = p+sz;
+                    return base+p;
+                }
+            }
+            pg = PagePool::instance().get();
+            pg->next = *pages;
+            *pages = pg;
+            char *base = reinterpret_cast<char *>(pg);
+            p = align_pos(base, pg->pos, align);
+            pg->pos = p+sz;
+            return base+p;
+        }
+
+        static std::size_t align_pos(const char *base, std::size_t pos, std::size_t align) {
+            std::size_t addr = reinterpret_cast<std::size_t>(base)+pos;
+            return pos + ((align - (addr & (align-1))) & (align-1));
+        }
+    };
+
     class AbstractCall {
     public:
         virtual ~AbstractCall() {}
         virtual void run() noexcept = 0;
-        virtual AbstractCall *move(char *buff, std::size_t &pos, std::size_t size) = 0;
+        virtual AbstractCall *move(Arena &arena) = 0;
     };
 
 
@@ -65,7 +176,7 @@ public:
     public:
         SingleCall(Fn &&fn):fn(std::forward<Fn>(fn)) {}
         virtual void run() noexcept {fn();}
-        AbstractCall *move(char *buff, std::size_t &pos, std::size_t size) {return this;}
+        AbstractCall *move(Arena &) {return this;}
     protected:
         Fn fn;
     };
@@ -75,7 +186,7 @@ public:
     public:
         ChainedCall(Fn &&fn, Ptr &&next):SingleCall<Fn>(std::forward<Fn>(fn)),next(std::move(next)) {}
         virtual void run() noexcept {this->fn();next->run();}
-        AbstractCall *move(char *buff, std::size_t &pos, std::size_t size) {return this;}
+        AbstractCall *move(Arena &) {return this;}
     protected:
         Ptr next;
     };
@@ -85,14 +196,12 @@ public:
     public:
         using SingleCall<Fn>::SingleCall;
         void operator delete(void *ptr, std::size_t sz) {}
-        AbstractCall *move(char *buff, std::size_t &pos, std::size_t size) {
-            auto sz = sizeof(SingleCallNoAlloc<Fn>);
+        AbstractCall *move(Arena &arena) {
+            void *p = arena.alloc(sizeof(SingleCallNoAlloc), alignof(SingleCallNoAlloc));
             AbstractCall *out;
-            if (pos+sz > size) {
+            if (p == nullptr) {
                 out = new SingleCall<Fn>(std::move(this->fn));
             } else {
-                void *p = buff+pos;
-                pos+=sz;
                 out = new(p) SingleCallNoAlloc(std::move(this->fn));
             }
             delete this;
@@ -104,15 +213,13 @@ public:
     public:
         using ChainedCall<Fn>::ChainedCall;
         void operator delete(void *ptr, std::size_t sz) {}
-        AbstractCall *move(char *buff, std::size_t &pos, std::size_t size) {
-            auto sz = sizeof(ChainedCallNoAlloc<Fn>);
+        AbstractCall *move(Arena &arena) {
+            void *p = arena.alloc(sizeof(ChainedCallNoAlloc), alignof(ChainedCallNoAlloc));
             AbstractCall *out;
-            if (pos+sz > size) {
-                out =  new ChainedCall<Fn>(std::move(this->fn), Ptr(this->next.release()->move(buff, pos, size)));
+            if (p == nullptr) {
+                out =  new ChainedCall<Fn>(std::move(this->fn), Ptr(this->next.release()->move(arena)));
             } else {
-                void *p = buff+pos;
-                pos+=sz;
-                out =  new(p) ChainedCallNoAlloc(std::move(this->fn), Ptr(this->next.release()->move(buff, pos, size)));
+                out =  new(p) ChainedCallNoAlloc(std::move(this->fn), Ptr(this->next.release()->move(arena)));
             }
             delete this;
             return out;
@@ -125,7 +232,7 @@ public:
 };
 
 
-template<std::size_t buffsz>
+template<std::size_t buffsz, bool arena>
 class Trailer: public Trailer_Defs {
 public:
 
@@ -171,14 +278,19 @@ public:
 
  protected:
     Ptr ptr;
-    char buffer[buffsz+sizeof(std::size_t)];
+    alignas(std::max_align_t) char buffer[buffsz+sizeof(std::size_t)];
     std::size_t aptr = 0;
+    Page *pages = nullptr;
 
-    void *alloc(std::size_t size) {
-        if (aptr+size > buffsz) return nullptr;
-        void *out = buffer+aptr;
-        aptr+=size;
-        return out;
+    Arena get_arena() {
+        return Arena{buffer, aptr, buffsz, arena?&pages:nullptr};
+    }
+
+    void release_pages() {
+        if (pages) {
+            PagePool::instance().put(pages);
+            pages = nullptr;
+        }
     }
 };
 ///Deferred trailer
@@ -189,20 +301,19 @@ class DeferredTrailer: public Trailer<sizeof(Trailer_Defs::SingleCallNoAlloc<T>)
 
 };;
 
-template<std::size_t buffsz>
+template<std::size_t buffsz, bool arena>
 template<typename Fn, typename >
-void Trailer<buffsz>::push(Fn &&fn) {
+void Trailer<buffsz, arena>::push(Fn &&fn) {
+    Arena ar = get_arena();
     if (ptr == nullptr)  {
-        std::size_t needsz = sizeof(SingleCallNoAlloc<Fn>);
-        void *a = alloc(needsz);
+        void *a = ar.alloc(sizeof(SingleCallNoAlloc<Fn>), alignof(SingleCallNoAlloc<Fn>));
         if (a == nullptr) {
             ptr = std::make_unique<SingleCall<Fn> >(std::forward<Fn>(fn));
         } else {
             ptr = Ptr(new(a) SingleCallNoAlloc<Fn>(std::forward<Fn>(fn)));
         }
     } else {
-        std::size_t needsz = sizeof(ChainedCallNoAlloc<Fn>);
-        void *a = alloc(needsz);
+        void *a = ar.alloc(sizeof(ChainedCallNoAlloc<Fn>), alignof(ChainedCallNoAlloc<Fn>));
         if (a == nullptr) {
             ptr = std::make_unique<ChainedCall<Fn> >(std::forward<Fn>(fn), std::move(ptr));
         } else {
@@ -211,22 +322,26 @@ void Trailer<buffsz>::push(Fn &&fn) {
     }
 }
 
-template<std::size_t buffsz>
-inline Trailer<buffsz>::~Trailer() {
+template<std::size_t buffsz, bool arena>
+inline Trailer<buffsz, arena>::~Trailer() {
     if (ptr != nullptr) ptr->run();
+    ptr = nullptr;
+    release_pages();
 }
 
-template<std::size_t buffsz>
-inline Trailer<buffsz>::Trailer(Trailer &&other) {
+template<std::size_t buffsz, bool arena>
+inline Trailer<buffsz, arena>::Trailer(Trailer &&other) {
     if (other.ptr != nullptr) {
-        ptr = Ptr(other.ptr.release()->move(buffer, aptr, buffsz));
+        Arena ar = get_arena();
+        ptr = Ptr(other.ptr.release()->move(ar));
     }
 }
 
-template<std::size_t buffsz>
-inline void Trailer<buffsz>::clear() {
+template<std::size_t buffsz, bool arena>
+inline void Trailer<buffsz, arena>::clear() {
     ptr = nullptr;
     aptr = 0;
+    release_pages();
 }
 
 template<typename Fn>